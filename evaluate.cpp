@@ -58,8 +58,16 @@ namespace Eval {
 
     std::string eval_file = std::string(Options["EvalFile"]);
     if (useNNUE != UseNNUEMode::False && eval_file_loaded != eval_file)
+    {
+        TimePoint start = now();
         if (Eval::NNUE::load_eval_file(eval_file))
+        {
+            Eval::NNUE::replicate_eval(Options["NUMA Replicate NNUE"]);
             eval_file_loaded = eval_file;
+            sync_cout << "info string NNUE network " << eval_file << " loaded in "
+                      << now() - start << " ms" << sync_endl;
+        }
+    }
   }
 
   void verify_NNUE() {
@@ -955,6 +963,11 @@ make_v:
 /// evaluation of the position from the point of view of the side to move.
 
 Value Eval::evaluate(const Position& pos) {
+#if defined(USE_STATS)
+  Thread* th = pos.this_thread();
+  SearchStats::Timer statsTimer(th->stats.evalTicks);
+  th->stats.evaluations++;
+#endif
 #ifdef EVAL_LEARN
   if (useNNUE == UseNNUEMode::Pure) {
       return NNUE::evaluate(pos);
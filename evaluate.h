@@ -48,8 +48,10 @@ namespace Eval {
 
     Value evaluate(const Position& pos);
     Value compute_eval(const Position& pos);
+    void  evaluate_batch(const Position* const* positions, std::size_t count, Value* values);
     void  update_eval(const Position& pos);
     bool  load_eval_file(const std::string& evalFile);
+    void  replicate_eval(bool replicate);
 
   } // namespace NNUE
 
@@ -482,7 +482,7 @@ namespace Learner
             {
                 if (fs.read((char*)&p, sizeof(PackedSfenValue))) {
                     StateInfo si;
-                    tpos.set_from_packed_sfen(p.sfen, &si, th, false);
+                    tpos.set_training_position(p.sfen, &si, th, false);
 
                     // write as plain text
                     ofs << "fen " << tpos.fen() << std::endl;
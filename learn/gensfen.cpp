@@ -166,12 +166,13 @@ namespace Learner
         ~SfenWriter()
         {
             finished = true;
-            file_worker_thread.join();
+            if (file_worker.valid())
+                file_worker.wait();
             output_file_stream.reset();
 
 #if defined(_DEBUG)
             {
-                // All buffers should be empty since file_worker_thread
+                // All buffers should be empty since file_worker
                 // should have written everything before exiting.
                 for (const auto& p : sfen_buffers) { assert(p == nullptr); (void)p ; }
                 assert(sfen_buffers_pool.empty());
@@ -223,10 +224,10 @@ namespace Learner
             }
         }
 
-        // Start the write_worker thread.
+        // Start the write worker on the task pool.
         void start_file_write_worker()
         {
-            file_worker_thread = std::thread([&] { this->file_write_worker(); });
+            file_worker = Threads.tasks.submit([&] { this->file_write_worker(); });
         }
 
         // Dedicated thread to write to file
@@ -319,8 +320,8 @@ namespace Learner
         // File name passed in the constructor
         std::string filename;
 
-        // Thread to write to the file
-        std::thread file_worker_thread;
+        // Worker writing to the file
+        std::future<void> file_worker;
 
         // Flag that all threads have finished
         atomic<bool> finished;
@@ -400,9 +401,10 @@ namespace Learner
         int search_depth_min;
         int search_depth_max;
 
-        // Number of the nodes to be searched.
+        // Min and max number of the nodes to be searched.
         // 0 represents no limits.
         uint64_t nodes;
+        uint64_t nodes_max;
 
         // Upper limit of evaluation value of generated situation
         int eval_limit;
@@ -865,8 +867,14 @@ namespace Learner
                     break;
                 }
 
+                // Node budget of this search. Every thread carries its own
+                // limits, so the budget can vary from search to search.
+                SearchLimits limits;
+                limits.depth = depth;
+                limits.nodes = nodes_max > nodes ? nodes + prng.rand(nodes_max - nodes + 1) : nodes;
+
                 {
-                    auto [search_value, search_pv] = search(pos, depth, 1, nodes);
+                    auto [search_value, search_pv] = search(pos, limits);
 
                     // Always adjudivate by eval limit.
                     // Also because of this we don't have to check for TB/MATE scores
@@ -1025,6 +1033,7 @@ namespace Learner
 
         // Number of nodes to be searched.
         uint64_t nodes = 0;
+        uint64_t nodes_max = 0;
 
         // minimum ply, maximum ply and number of random moves
         int random_move_minply = 1;
@@ -1071,6 +1080,8 @@ namespace Learner
                 is >> search_depth_max;
             else if (token == "nodes")
                 is >> nodes;
+            else if (token == "nodes2")
+                is >> nodes_max;
             else if (token == "loop")
                 is >> loop_max;
             else if (token == "output_file_name")
@@ -1154,7 +1165,7 @@ namespace Learner
 
         std::cout << "gensfen : " << endl
             << "  search_depth_min = " << search_depth_min << " to " << search_depth_max << endl
-            << "  nodes = " << nodes << endl
+            << "  nodes = " << nodes << " to " << std::max(nodes, nodes_max) << endl
             << "  loop_max = " << loop_max << endl
             << "  eval_limit = " << eval_limit << endl
             << "  thread_num (set by USI setoption) = " << thread_num << endl
@@ -1186,6 +1197,7 @@ namespace Learner
 
             MultiThinkGenSfen multi_think(search_depth_min, search_depth_max, sfen_writer);
             multi_think.nodes = nodes;
+            multi_think.nodes_max = nodes_max;
             multi_think.set_loop_max(loop_max);
             multi_think.eval_limit = eval_limit;
             multi_think.random_move_minply = random_move_minply;
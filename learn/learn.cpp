@@ -35,6 +35,7 @@
 
 #include "extra/nnue_data_binpack_format.h"
 
+#include "nnue/evaluate_nnue.h"
 #include "nnue/evaluate_nnue_learner.h"
 
 #include "syzygy/tbprobe.h"
@@ -49,6 +50,7 @@
 #include <limits>
 #include <list>
 #include <memory>
+#include <numeric>
 #include <optional>
 #include <random>
 #include <regex>
@@ -452,8 +454,8 @@ namespace Learner
 
         ~SfenReader()
         {
-            if (file_worker_thread.joinable())
-                file_worker_thread.join();
+            if (file_worker.valid())
+                file_worker.wait();
         }
 
         // Load the phase for calculation such as mse.
@@ -569,10 +571,10 @@ namespace Learner
 
         }
 
-        // Start a thread that loads the phase file in the background.
+        // Start a task pool job that loads the phase file in the background.
         void start_file_read_worker()
         {
-            file_worker_thread = std::thread([&] {
+            file_worker = Threads.tasks.submit([&] {
                 this->file_read_worker();
                 });
         }
@@ -713,8 +715,8 @@ namespace Learner
 
     protected:
 
-        // worker thread reading file in background
-        std::thread file_worker_thread;
+        // worker reading file in background
+        std::future<void> file_worker;
 
         // Random number to shuffle when reading the phase
         PRNG prng;
@@ -772,7 +774,7 @@ namespace Learner
             sr.start_file_read_worker();
         }
 
-        Value get_shallow_value(Position& task_pos);
+        void get_shallow_values(Position* const* positions, size_t count, Value* values);
 
         // save merit function parameters to a file
         bool save(bool is_final = false);
@@ -828,6 +830,13 @@ namespace Learner
         uint64_t loss_output_interval;
         uint64_t mirror_percentage;
 
+        // Skip qsearch and take the features straight from the packed sfen.
+        // Only meant for training data that is already quiet.
+        bool skip_qsearch;
+
+        // Time of the last progress output, for the sfens/s figure
+        TimePoint last_progress_time;
+
         // Loss calculation.
         // done: Number of phases targeted this time
         void calc_loss(size_t thread_id, uint64_t done);
@@ -836,31 +845,40 @@ namespace Learner
         TaskDispatcher task_dispatcher;
     };
 
-    Value LearnerThink::get_shallow_value(Position& task_pos)
+    void LearnerThink::get_shallow_values(Position* const* positions, size_t count, Value* values)
     {
         // Evaluation value for shallow search
         // The value of evaluate() may be used, but when calculating loss, learn_cross_entropy and
         // Use qsearch() because it is difficult to compare the values.
         // EvalHash has been disabled in advance. (If not, the same value will be returned every time)
-        const auto [_, pv] = qsearch(task_pos);
+        std::vector<ValueAndPV> results(count);
+        std::vector<std::vector<StateInfo, AlignedAllocator<StateInfo>>> states(count);
+        qsearch(positions, count, results.data());
 
-        std::vector<StateInfo, AlignedAllocator<StateInfo>> states(pv.size());
-        for (size_t i = 0; i < pv.size(); ++i)
+        for (size_t i = 0; i < count; ++i)
         {
-            task_pos.do_move(pv[i], states[i]);
-            Eval::NNUE::update_eval(task_pos);
-        }
+            Position& task_pos = *positions[i];
+            const std::vector<Move>& pv = results[i].second;
 
-        const auto rootColor = task_pos.side_to_move();
-        const Value shallow_value =
-            (rootColor == task_pos.side_to_move())
-            ? Eval::evaluate(task_pos)
-            : -Eval::evaluate(task_pos);
+            states[i].resize(pv.size());
+            for (size_t j = 0; j < pv.size(); ++j)
+            {
+                task_pos.do_move(pv[j], states[i][j]);
+                Eval::NNUE::update_eval(task_pos);
+            }
+        }
 
-        for (auto it = pv.rbegin(); it != pv.rend(); ++it)
-            task_pos.undo_move(*it);
+        // The leaves of all the PVs are evaluated together when the pure
+        // NNUE evaluation is used, so that the network runs on a whole batch.
+        if (Eval::useNNUE == Eval::UseNNUEMode::Pure)
+            Eval::NNUE::evaluate_batch(positions, count, values);
+        else
+            for (size_t i = 0; i < count; ++i)
+                values[i] = Eval::evaluate(*positions[i]);
 
-        return shallow_value;
+        for (size_t i = 0; i < count; ++i)
+            for (auto it = results[i].second.rbegin(); it != results[i].second.rend(); ++it)
+                positions[i]->undo_move(*it);
     }
 
     void LearnerThink::calc_loss(size_t thread_id, uint64_t done)
@@ -870,8 +888,13 @@ namespace Learner
         // It doesn't matter if you have disabled the substitution table.
         TT.new_search();
 
+        const TimePoint elapsed = now() - last_progress_time + 1;
+        last_progress_time = now();
+
         std::cout << "PROGRESS: " << now_string() << ", ";
         std::cout << sr.total_done << " sfens";
+        if (done != static_cast<uint64_t>(-1))
+            std::cout << ", " << done * 1000 / elapsed << " sfens/s";
         std::cout << ", iteration " << epoch;
         std::cout << ", eta = " << Eval::get_eta() << ", ";
 
@@ -905,13 +928,17 @@ namespace Learner
         // troublesome because the search before slave has not finished.
         // I created a mechanism to call task, so I will use it.
 
-        // The number of tasks to do.
+        // The number of tasks to do. Each task handles up to
+        // Eval::NNUE::kMaxBatchSize consecutive positions, so that
+        // the leaves of their shallow searches can be evaluated together.
+        const size_t batch_size = Eval::NNUE::kMaxBatchSize;
+        const size_t num_sfens = sr.sfen_for_mse.size();
         atomic<int> task_count;
-        task_count = (int)sr.sfen_for_mse.size();
+        task_count = (int)((num_sfens + batch_size - 1) / batch_size);
         task_dispatcher.task_reserve(task_count);
 
         // Create a task to search for the situation and give it to each thread.
-        for (const auto& ps : sr.sfen_for_mse)
+        for (size_t begin = 0; begin < num_sfens; begin += batch_size)
         {
             // Assign work to each thread using TaskDispatcher.
             // A task definition for that.
@@ -920,7 +947,9 @@ namespace Learner
             auto task =
                 [
                     this,
-                    &ps,
+                    begin,
+                    batch_size,
+                    num_sfens,
                     &test_sum_cross_entropy_eval,
                     &test_sum_cross_entropy_win,
                     &test_sum_cross_entropy,
@@ -933,56 +962,71 @@ namespace Learner
                 ](size_t task_thread_id)
             {
                 auto task_th = Threads[task_thread_id];
-                auto& task_pos = task_th->rootPos;
-                StateInfo task_si;
-                if (task_pos.set_from_packed_sfen(ps.sfen, &task_si, task_th) != 0)
-                {
-                    // Unfortunately, as an sfen for rmse calculation, an invalid sfen was drawn.
-                    cout << "Error! : illegal packed sfen " << task_pos.fen() << endl;
-                }
-
-                const Value shallow_value = get_shallow_value(task_pos);
-
-                // Evaluation value of deep search
-                auto deep_value = (Value)ps.score;
-
-                // Note) This code does not consider when
-                //       eval_limit is specified in the learn command.
+                const size_t count = std::min(batch_size, num_sfens - begin);
 
-                // --- calculation of cross entropy
+                std::vector<Position> task_positions(count);
+                std::vector<StateInfo, AlignedAllocator<StateInfo>> task_si(count);
+                std::vector<Position*> positions(count);
+                std::vector<Value> shallow_values(count);
 
-                // For the time being, regarding the win rate and loss terms only in the elmo method
-                // Calculate and display the cross entropy.
-
-                double test_cross_entropy_eval, test_cross_entropy_win, test_cross_entropy;
-                double test_entropy_eval, test_entropy_win, test_entropy;
-                calc_cross_entropy(
-                    deep_value,
-                    shallow_value,
-                    ps,
-                    test_cross_entropy_eval,
-                    test_cross_entropy_win,
-                    test_cross_entropy,
-                    test_entropy_eval,
-                    test_entropy_win,
-                    test_entropy);
-
-                // The total cross entropy need not be abs() by definition.
-                test_sum_cross_entropy_eval += test_cross_entropy_eval;
-                test_sum_cross_entropy_win += test_cross_entropy_win;
-                test_sum_cross_entropy += test_cross_entropy;
-                test_sum_entropy_eval += test_entropy_eval;
-                test_sum_entropy_win += test_entropy_win;
-                test_sum_entropy += test_entropy;
-                sum_norm += (double)abs(shallow_value);
-
-                // Determine if the teacher's move and the score of the shallow search match
+                for (size_t i = 0; i < count; ++i)
                 {
+                    const auto& ps = sr.sfen_for_mse[begin + i];
+                    auto& task_pos = task_positions[i];
+                    positions[i] = &task_pos;
+                    if (task_pos.set_from_packed_sfen(ps.sfen, &task_si[i], task_th) != 0)
+                    {
+                        // Unfortunately, as an sfen for rmse calculation, an invalid sfen was drawn.
+                        cout << "Error! : illegal packed sfen " << task_pos.fen() << endl;
+                    }
+
+                    // Determine if the teacher's move and the score of the shallow search match
                     const auto [value, pv] = search(task_pos, 1);
                     if ((uint16_t)pv[0] == ps.move)
                         move_accord_count.fetch_add(1, std::memory_order_relaxed);
                 }
 
+                get_shallow_values(positions.data(), count, shallow_values.data());
+
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const auto& ps = sr.sfen_for_mse[begin + i];
+                    const Value shallow_value = shallow_values[i];
+
+                    // Evaluation value of deep search
+                    auto deep_value = (Value)ps.score;
+
+                    // Note) This code does not consider when
+                    //       eval_limit is specified in the learn command.
+
+                    // --- calculation of cross entropy
+
+                    // For the time being, regarding the win rate and loss terms only in the elmo method
+                    // Calculate and display the cross entropy.
+
+                    double test_cross_entropy_eval, test_cross_entropy_win, test_cross_entropy;
+                    double test_entropy_eval, test_entropy_win, test_entropy;
+                    calc_cross_entropy(
+                        deep_value,
+                        shallow_value,
+                        ps,
+                        test_cross_entropy_eval,
+                        test_cross_entropy_win,
+                        test_cross_entropy,
+                        test_entropy_eval,
+                        test_entropy_win,
+                        test_entropy);
+
+                    // The total cross entropy need not be abs() by definition.
+                    test_sum_cross_entropy_eval += test_cross_entropy_eval;
+                    test_sum_cross_entropy_win += test_cross_entropy_win;
+                    test_sum_cross_entropy += test_cross_entropy;
+                    test_sum_entropy_eval += test_entropy_eval;
+                    test_sum_entropy_win += test_entropy_win;
+                    test_sum_entropy += test_entropy;
+                    sum_norm += (double)abs(shallow_value);
+                }
+
                 // Reduced one task because I did it
                 --task_count;
             };
@@ -1018,7 +1062,8 @@ namespace Learner
                 << " , norm = " << sum_norm
                 << " , move accuracy = " << (move_accord_count * 100.0 / sr.sfen_for_mse.size()) << "%";
 
-            if (done != static_cast<uint64_t>(-1))
+            // Nothing is evaluated for the training data when qsearch is skipped.
+            if (done != static_cast<uint64_t>(-1) && !skip_qsearch)
             {
                 cout
                     << " , learn_cross_entropy_eval = " << learn_sum_cross_entropy_eval / done
@@ -1168,6 +1213,21 @@ namespace Learner
 
             StateInfo si;
             const bool mirror = prng.rand(100) < mirror_percentage;
+
+            if (skip_qsearch)
+            {
+                // No Position is set up, the features are extracted
+                // directly from the packed sfen.
+                if (!Eval::NNUE::AddExample(ps, mirror, 1.0))
+                {
+                    cout << "Error! : illigal packed sfen" << endl;
+                    goto RETRY_READ;
+                }
+
+                sr.total_done++;
+                continue;
+            }
+
             if (pos.set_from_packed_sfen(ps.sfen, &si, th, mirror) != 0)
             {
                 // I got a strange sfen. Should be debugged!
@@ -1451,7 +1511,10 @@ namespace Learner
         // There should have been a limit of 512 per process on Windows, so you can open here as 500,
         // The current setting is 500 files x 20M = 10G = 10 billion phases.
 
-        PSVector buf(buffer_size);
+        // While a full buffer is shuffled and written by the task pool, the
+        // next one is read into the other buffer, so twice this memory is used.
+        PSVector buf(buffer_size), write_buf(buffer_size);
+        std::future<void> writing;
 
         // ↑ buffer, a marker that indicates how much you have used
         uint64_t buf_write_marker = 0;
@@ -1474,17 +1537,28 @@ namespace Learner
 
         auto write_buffer = [&](uint64_t size)
         {
-            Algo::shuffle(buf, prng);
-
-            // write to a file
-            fstream fs;
-            fs.open(make_filename(write_file_count++), ios::out | ios::binary);
-            fs.write(reinterpret_cast<char*>(buf.data()), size * sizeof(PackedSfenValue));
-            fs.close();
-            a_count.push_back(size);
+            if (writing.valid())
+                writing.wait();
 
+            buf.swap(write_buf);
             buf_write_marker = 0;
-            cout << ".";
+
+            writing = Threads.tasks.submit([&, size, filename = make_filename(write_file_count++)]()
+            {
+                // Only shuffle the part that was read.
+                write_buf.resize(size);
+                Algo::shuffle(write_buf, prng);
+                write_buf.resize(buffer_size);
+
+                // write to a file
+                fstream fs;
+                fs.open(filename, ios::out | ios::binary);
+                fs.write(reinterpret_cast<char*>(write_buf.data()), size * sizeof(PackedSfenValue));
+                fs.close();
+                a_count.push_back(size);
+
+                cout << ".";
+            });
         };
 
         std::filesystem::create_directory("tmp");
@@ -1507,6 +1581,9 @@ namespace Learner
         if (buf_write_marker != 0)
             write_buffer(buf_write_marker);
 
+        if (writing.valid())
+            writing.wait();
+
         // Only shuffled files have been written write_file_count.
         // As a second pass, if you open all of them at the same time,
         // select one at random and load one phase at a time
@@ -1703,6 +1780,7 @@ namespace Learner
         uint64_t eval_save_interval = LEARN_EVAL_SAVE_INTERVAL;
         uint64_t loss_output_interval = 0;
         uint64_t mirror_percentage = 0;
+        bool skip_qsearch = false;
 
         string validation_set_file_name;
 
@@ -1796,6 +1874,7 @@ namespace Learner
             else if (option == "eval_save_interval") is >> eval_save_interval;
             else if (option == "loss_output_interval") is >> loss_output_interval;
             else if (option == "mirror_percentage") is >> mirror_percentage;
+            else if (option == "skip_qsearch") is >> skip_qsearch;
             else if (option == "validation_set_file_name") is >> validation_set_file_name;
 
             // Rabbit convert related
@@ -1969,6 +2048,7 @@ namespace Learner
         cout << "LAMBDA_LIMIT      : " << ELMO_LAMBDA_LIMIT << endl;
 
         cout << "mirror_percentage : " << mirror_percentage << endl;
+        cout << "skip_qsearch      : " << skip_qsearch << endl;
         cout << "eval_save_interval  : " << eval_save_interval << " sfens" << endl;
         cout << "loss_output_interval: " << loss_output_interval << " sfens" << endl;
 
@@ -2014,6 +2094,8 @@ namespace Learner
         learn_think.eval_save_interval = eval_save_interval;
         learn_think.loss_output_interval = loss_output_interval;
         learn_think.mirror_percentage = mirror_percentage;
+        learn_think.skip_qsearch = skip_qsearch;
+        learn_think.last_progress_time = now();
 
         // Start a thread that loads the phase file in the background
         // (If this is not started, mse cannot be calculated.)
@@ -2053,6 +2135,199 @@ namespace Learner
         learn_think.save(true);
     }
 
+    // Score every position of a .bin/.binpack file with the batched NNUE
+    // evaluation and report the throughput.
+    // usage: evalbatch <file> [count <n>]
+    void eval_batch(std::istringstream& is)
+    {
+        std::string filename;
+        uint64_t count_limit = std::numeric_limits<uint64_t>::max();
+
+        is >> filename;
+
+        std::string token;
+        while (is >> token)
+        {
+            if (token == "count")
+                is >> count_limit;
+            else
+                cout << "Error! : Illegal token " << token << endl;
+        }
+
+        if (filename.empty())
+        {
+            cout << "usage: evalbatch <file> [count <n>]" << endl;
+            return;
+        }
+
+        auto input = open_sfen_input_file(filename);
+        if (!input)
+        {
+            cout << "Error! : unknown file type " << filename << endl;
+            return;
+        }
+
+        Eval::init_NNUE();
+
+        std::vector<PackedSfenValue> sfens;
+        while (sfens.size() < count_limit)
+        {
+            auto v = input->next();
+            if (!v.has_value())
+                break;
+            sfens.emplace_back(*v);
+        }
+
+        const size_t num_sfens = sfens.size();
+        const size_t batch_size = Eval::NNUE::kMaxBatchSize;
+        const size_t thread_num = std::min((size_t)Options["Threads"], Threads.size());
+
+        cout << "evalbatch: " << num_sfens << " sfens from " << filename
+             << ", " << thread_num << " threads" << endl;
+
+        std::atomic<size_t> next_index(0);
+        std::atomic<int64_t> sum_abs_eval(0), sum_abs_error(0);
+        std::atomic<uint64_t> illegal(0);
+
+        auto worker = [&](size_t thread_id)
+        {
+            auto th = Threads[thread_id];
+            std::vector<Position> positions(batch_size);
+            std::vector<StateInfo, AlignedAllocator<StateInfo>> si(batch_size);
+            std::vector<const Position*> batch(batch_size);
+            std::vector<size_t> index(batch_size);
+            std::vector<Value> values(batch_size);
+            int64_t local_abs_eval = 0, local_abs_error = 0;
+
+            for (size_t begin; (begin = next_index.fetch_add(batch_size)) < num_sfens; )
+            {
+                const size_t end = std::min(begin + batch_size, num_sfens);
+                size_t count = 0;
+                for (size_t i = begin; i < end; ++i)
+                {
+                    // Only the pieces are needed by the network. A record that
+                    // fails to decode may lack the kings, so it is skipped.
+                    if (positions[count].set_training_position(sfens[i].sfen, &si[count], th) != 0)
+                    {
+                        illegal.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+                    batch[count] = &positions[count];
+                    index[count++] = i;
+                }
+
+                Eval::NNUE::evaluate_batch(batch.data(), count, values.data());
+
+                for (size_t i = 0; i < count; ++i)
+                {
+                    local_abs_eval += std::abs(values[i]);
+                    local_abs_error += std::abs(values[i] - sfens[index[i]].score);
+                }
+            }
+
+            sum_abs_eval += local_abs_eval;
+            sum_abs_error += local_abs_error;
+        };
+
+        const auto start = now();
+
+        Threads.tasks.parallel_for(thread_num, worker);
+
+        const TimePoint elapsed = now() - start + 1;
+        const size_t evaluated = num_sfens - illegal;
+
+        cout << "positions    : " << num_sfens << endl
+             << "illegal      : " << illegal << endl
+             << "time (ms)    : " << elapsed << endl
+             << "pos/s        : " << evaluated * 1000 / elapsed << endl
+             << "mean |eval|  : " << (evaluated ? (double)sum_abs_eval / evaluated : 0.0) << endl
+             << "mean |eval - score| : " << (evaluated ? (double)sum_abs_error / evaluated : 0.0) << endl;
+    }
+
+    // Compare the qsearch() of every position on its own with the batched
+    // qsearch(), and report the time per position and the per-call overhead
+    // saved by the batch. The results of both must be identical, so the
+    // positions and the transposition table are reset before each pass.
+    // usage: test qsearch <file> [count]
+    void test_qsearch(std::istringstream& is)
+    {
+        std::string filename;
+        size_t count_limit = 100000;
+
+        is >> filename >> count_limit;
+
+        auto input = filename.empty() ? nullptr : open_sfen_input_file(filename);
+        if (!input)
+        {
+            cout << "usage: test qsearch <file> [count]" << endl;
+            return;
+        }
+
+        std::vector<PackedSfenValue> sfens;
+        while (sfens.size() < count_limit)
+        {
+            auto v = input->next();
+            if (!v.has_value())
+                break;
+            sfens.emplace_back(*v);
+        }
+
+        auto th = Threads.main();
+        std::vector<Position> positions(sfens.size());
+        std::vector<StateInfo, AlignedAllocator<StateInfo>> si(sfens.size());
+        std::vector<Position*> batch(sfens.size());
+
+        // A record that fails to decode may lack the kings, so it is dropped
+        size_t num_sfens = 0;
+        for (const auto& ps : sfens)
+        {
+            if (positions[num_sfens].set_from_packed_sfen(ps.sfen, &si[num_sfens], th) != 0)
+            {
+                cout << "Error! : illegal packed sfen, skipped" << endl;
+                continue;
+            }
+            sfens[num_sfens] = ps;
+            batch[num_sfens] = &positions[num_sfens];
+            ++num_sfens;
+        }
+
+        // A search leaves the piece lists of a position in another order,
+        // which changes the move order and so the pruning of qsearch(). The
+        // positions are set up again before the second pass.
+        auto setup = [&]() {
+            for (size_t i = 0; i < num_sfens; ++i)
+                positions[i].set_from_packed_sfen(sfens[i].sfen, &si[i], th);
+        };
+
+        std::vector<ValueAndPV> single(num_sfens), batched(num_sfens);
+
+        TT.clear();
+        TimePoint start = now();
+        for (size_t i = 0; i < num_sfens; ++i)
+            single[i] = qsearch(positions[i]);
+        const TimePoint single_time = now() - start + 1;
+
+        setup();
+        TT.clear();
+        start = now();
+        for (size_t begin = 0; begin < num_sfens; begin += Eval::NNUE::kMaxBatchSize)
+            qsearch(batch.data() + begin,
+                    std::min<size_t>(Eval::NNUE::kMaxBatchSize, num_sfens - begin),
+                    batched.data() + begin);
+        const TimePoint batch_time = now() - start + 1;
+
+        const size_t mismatches = num_sfens - std::inner_product(
+            single.begin(), single.end(), batched.begin(), size_t(0),
+            std::plus<size_t>(), std::equal_to<ValueAndPV>());
+
+        const double n = std::max<double>(num_sfens, 1);
+        cout << "positions         : " << num_sfens << endl
+             << "mismatches        : " << mismatches << endl
+             << "single (us/pos)   : " << single_time * 1000 / n << endl
+             << "batched (us/pos)  : " << batch_time * 1000 / n << endl
+             << "overhead (us/call): " << (single_time - batch_time) * 1000 / n << endl;
+    }
+
 } // namespace Learner
 
 #endif // EVAL_LEARN
@@ -76,6 +76,12 @@ namespace Learner
 
     // Learning from the generated game record
     void learn(Position& pos, std::istringstream& is);
+
+    // Score all the positions of a training data file with the batched NNUE evaluation
+    void eval_batch(std::istringstream& is);
+
+    // Compare the single and the batched qsearch() on a training data file
+    void test_qsearch(std::istringstream& is);
 }
 
 #endif
@@ -2,12 +2,11 @@
 
 #include "multi_think.h"
 
+#include "thread.h"
 #include "tt.h"
 #include "uci.h"
 #include "types.h"
 
-#include <thread>
-
 void MultiThink::go_think()
 {
 	// Keep a copy to restore the Options settings later.
@@ -29,8 +28,8 @@ void MultiThink::go_think()
 	loop_count = 0;
 	done_count = 0;
 
-	// Create threads as many as Options["Threads"] and start thinking.
-	std::vector<std::thread> threads;
+	// Run as many workers as Options["Threads"] on the task pool and start thinking.
+	std::vector<std::future<void>> workers;
 	auto thread_num = (size_t)Options["Threads"];
 
 	// Secure end flag of worker thread
@@ -40,7 +39,7 @@ void MultiThink::go_think()
 	for (size_t i = 0; i < thread_num; ++i)
 	{
 		thread_finished[i] = 0;
-		threads.push_back(std::thread([i, this]
+		workers.push_back(Threads.tasks.submit([i, this]
 		{
 			// exhaust all processor threads.
 			WinProcGroup::bindThisThread(i);
@@ -104,9 +103,9 @@ void MultiThink::go_think()
 	// → It should be saved by the caller, so I feel that it is not necessary here.
 
 	// It is possible that the exit code of the thread is running but the exit code of the thread is running, so
-	// We need to wait for the end with join().
-	for (auto& th : threads)
-		th.join();
+	// We need to wait for the end of the workers.
+	for (auto& w : workers)
+		w.wait();
 
 	// The file writing thread etc. are still running only when all threads are finished
 	// Since the work itself may not have completed, output only that all threads have finished.
@@ -6,34 +6,243 @@
 
 #include "misc.h"
 #include "position.h"
+#include "thread.h"
 
 #include <sstream>
 #include <fstream>
+#include <cstddef> // offsetof()
 #include <cstring> // std::memset()
+#include <array>
 
 using namespace std;
 
 namespace Learner {
 
+  // Huffman coding
+  // * is simplified from mini encoding to make conversion easier.
+  //
+  // 1 box on the board (other than NO_PIECE) = 2 to 6 bits (+ 1-bit flag + 1-bit forward and backward)
+  // 1 piece of hand piece = 1-5bit (+ 1-bit flag + 1bit ahead and behind)
+  //
+  // empty xxxxx0 + 0 (none)
+  // step xxxx01 + 2 xxxx0 + 2
+  // incense xx0011 + 2 xx001 + 2
+  // Katsura xx1011 + 2 xx101 + 2
+  // silver xx0111 + 2 xx011 + 2
+  // Gold x01111 + 1 x0111 + 1 // Gold is valid and has no flags.
+  // corner 011111 + 2 01111 + 2
+  // Fly 111111 + 2 11111 + 2
+  //
+  // Assuming all pieces are on the board,
+  // Sky 81-40 pieces = 41 boxes = 41bit
+  // Walk 4bit*18 pieces = 72bit
+  // Incense 6bit*4 pieces = 24bit
+  // Katsura 6bit*4 pieces = 24bit
+  // Silver 6bit*4 pieces = 24bit
+  // Gold 6bit* 4 pieces = 24bit
+  // corner 8bit* 2 pieces = 16bit
+  // Fly 8bit* 2 pieces = 16bit
+  // -------
+  // 241bit + 1bit (turn) + 7bit × 2 (King's position after) = 256bit
+  //
+  // When the piece on the board moves to the hand piece, the piece on the board becomes empty, so the box on the board can be expressed with 1 bit,
+  // Since the hand piece can be expressed by 1 bit less than the piece on the board, the total number of bits does not change in the end.
+  // Therefore, in this expression, any aspect can be expressed by this bit number.
+  // It is a hand piece and no flag is required, but if you include this, the bit number of the piece on the board will be -1
+  // Since the total number of bits can be fixed, we will include this as well.
+
+  // Huffman Encoding
+  //
+  // Empty  xxxxxxx0
+  // Pawn   xxxxx001 + 1 bit (Side to move)
+  // Knight xxxxx011 + 1 bit (Side to move)
+  // Bishop xxxxx101 + 1 bit (Side to move)
+  // Rook   xxxxx111 + 1 bit (Side to move)
+
+  struct HuffmanedPiece
+  {
+    int code; // how it will be coded
+    int bits; // How many bits do you have
+  };
+
+  constexpr HuffmanedPiece huffman_table[] =
+  {
+    {0b0000,1}, // NO_PIECE
+    {0b0001,4}, // PAWN
+    {0b0011,4}, // KNIGHT
+    {0b0101,4}, // BISHOP
+    {0b0111,4}, // ROOK
+    {0b1001,4}, // QUEEN
+  };
+
+  struct DecodedPiece
+  {
+    Piece pc; // the piece, NO_PIECE for an empty square
+    int bits; // code length including the color flag, 0 if invalid
+  };
+
+  // Decoding table of a board piece, indexed by the next 5 bits of the stream.
+  constexpr auto piece_decode_table = [] {
+    std::array<DecodedPiece, 32> table{};
+    for (int i = 0; i < 32; ++i)
+    {
+      table[i] = { NO_PIECE, (i & 1) ? 0 : 1 };
+      for (int pt = PAWN; pt < KING; ++pt)
+        if (huffman_table[pt].code == (i & 15))
+          table[i] = { make_piece(Color(i >> 4), PieceType(pt)), huffman_table[pt].bits + 1 };
+    }
+    return table;
+  }();
+
   // Class that handles bitstream
   // useful when doing aspect encoding
+  // The 256 bits are held in 64-bit words, so that a field of up to 57 bits
+  // is read or written with a couple of shifts instead of bit by bit.
   struct BitStream
   {
-    // Set the memory to store the data in advance.
-    // Assume that memory is cleared to 0.
-    void set_data(std::uint8_t* data_) { data = data_; reset(); }
+    // Load the data, an array of 32 bytes. The words are assembled from the
+    // bytes so that the layout does not depend on the endianness.
+    // Assume that memory is cleared to 0 when writing.
+    void set_data(std::uint8_t* data_)
+    {
+      data = data_;
+      for (int i = 0; i < 4; ++i)
+      {
+        uint64_t w = 0;
+        for (int b = 7; b >= 0; --b)
+          w = (w << 8) | data[8 * i + b];
+        words[i] = w;
+      }
+      std::fill(words + 4, words + 8, 0);
+      reset();
+    }
 
-    // Get the pointer passed in set_data().
-    uint8_t* get_data() const { return data; }
+    // Store the written words back to the data passed in set_data().
+    void flush()
+    {
+      for (int i = 0; i < 4; ++i)
+        for (int b = 0; b < 8; ++b)
+          data[8 * i + b] = uint8_t(words[i] >> (8 * b));
+    }
 
     // Get the cursor.
     int get_cursor() const { return bit_cursor; }
 
     // reset the cursor
-    void reset() { bit_cursor = 0; }
+    void reset() { bit_cursor = cached = 0; }
 
     // Write 1bit to the stream.
     // If b is non-zero, write out 1. If 0, write 0.
+    void write_one_bit(int b) { write_n_bit(b != 0, 1); }
+
+    // Get 1 bit from the stream.
+    int read_one_bit() { return read_n_bit(1); }
+
+    // write n bits of data
+    // Data shall be written out from the lower order of d.
+    void write_n_bit(int d, int n)
+    {
+      const uint64_t v = uint64_t(d) & ((1ULL << n) - 1);
+      const int w = bit_cursor / 64, s = bit_cursor % 64;
+
+      words[w] |= v << s;
+      if (s + n > 64)
+        words[w + 1] |= v >> (64 - s);
+
+      bit_cursor += n;
+    }
+
+    // read n bits of data
+    // Reverse conversion of write_n_bit().
+    int read_n_bit(int n)
+    {
+      refill(n);
+
+      int result = int(cache & ((1ULL << n) - 1));
+      consume(n);
+
+      return result;
+    }
+
+    // Output the board pieces to stream.
+    void write_piece(Piece pc)
+    {
+      // piece type
+      auto c = huffman_table[type_of(pc)];
+
+      // The color flag follows the code of a piece.
+      if (pc != NO_PIECE)
+        write_n_bit(c.code | (color_of(pc) << c.bits), c.bits + 1);
+      else
+        write_n_bit(c.code, c.bits);
+    }
+
+    // Read one board piece from stream. Returns PIECE_NB on a code that
+    // does not belong to any piece.
+    Piece read_piece()
+    {
+      refill(5);
+
+      auto d = piece_decode_table[cache & 31];
+      consume(d.bits);
+
+      return d.bits ? d.pc : PIECE_NB;
+    }
+
+  private:
+    // The next 64 bits from the cursor, zero past the end of the data.
+    uint64_t peek() const
+    {
+      const int w = bit_cursor / 64, s = bit_cursor % 64;
+
+      return s ? (words[w] >> s) | (words[w + 1] << (64 - s)) : words[w];
+    }
+
+    // Make sure that at least n bits from the cursor are in the cache. Most
+    // reads are served from the cache without going back to the words.
+    void refill(int n)
+    {
+      if (cached < n)
+      {
+        cache = peek();
+        cached = 64;
+      }
+    }
+
+    void consume(int n)
+    {
+      cache >>= n;
+      cached -= n;
+      bit_cursor += n;
+    }
+
+    // The data followed by zero words, so that reading past the 256 bits of
+    // a corrupt sfen stays in bounds.
+    uint64_t words[8];
+
+    // The bits from the cursor on, and how many of them are valid.
+    uint64_t cache;
+    int cached;
+
+    // Next bit position to read/write.
+    int bit_cursor;
+
+    // data entity
+    std::uint8_t* data;
+  };
+
+  // The original bit-at-a-time stream. It is kept as the reference that
+  // "test sfen" checks BitStream against.
+  struct ReferenceBitStream
+  {
+    void set_data(std::uint8_t* data_) { data = data_; reset(); }
+
+    void flush() {}
+
+    int get_cursor() const { return bit_cursor; }
+
+    void reset() { bit_cursor = 0; }
+
     void write_one_bit(int b)
     {
       if (b)
@@ -42,25 +251,21 @@ namespace Learner {
       ++bit_cursor;
     }
 
-    // Get 1 bit from the stream.
+    // Past the 256 bits of a corrupt sfen zeros are read, like BitStream does.
     int read_one_bit()
     {
-      int b = (data[bit_cursor / 8] >> (bit_cursor & 7)) & 1;
+      int b = bit_cursor < 256 ? (data[bit_cursor / 8] >> (bit_cursor & 7)) & 1 : 0;
       ++bit_cursor;
 
       return b;
     }
 
-    // write n bits of data
-    // Data shall be written out from the lower order of d.
     void write_n_bit(int d, int n)
     {
       for (int i = 0; i <n; ++i)
         write_one_bit(d & (1 << i));
     }
 
-    // read n bits of data
-    // Reverse conversion of write_n_bit().
     int read_n_bit(int n)
     {
       int result = 0;
@@ -70,11 +275,49 @@ namespace Learner {
       return result;
     }
 
+    void write_piece(Piece pc)
+    {
+      PieceType pr = type_of(pc);
+      auto c = huffman_table[pr];
+      write_n_bit(c.code, c.bits);
+
+      if (pc == NO_PIECE)
+        return;
+
+      // first and second flag
+      write_one_bit(color_of(pc));
+    }
+
+    Piece read_piece()
+    {
+      PieceType pr = NO_PIECE_TYPE;
+      int code = 0, bits = 0;
+      while (true)
+      {
+        code |= read_one_bit() << bits;
+        ++bits;
+
+        for (pr = NO_PIECE_TYPE; pr <KING; ++pr)
+          if (huffman_table[pr].code == code
+            && huffman_table[pr].bits == bits)
+            goto Found;
+
+        // No piece has a code this long, the sfen is corrupt
+        if (bits >= 5)
+          return PIECE_NB;
+      }
+    Found:;
+      if (pr == NO_PIECE_TYPE)
+        return NO_PIECE;
+
+      // first and second flag
+      Color c = (Color)read_one_bit();
+
+      return make_piece(c, pr);
+    }
+
   private:
-    // Next bit position to read/write.
     int bit_cursor;
-
-    // data entity
     std::uint8_t* data;
   };
 
@@ -94,85 +337,11 @@ namespace Learner {
   //
   // TODO(someone): Rename SFEN to FEN.
   //
-  struct SfenPacker
-  {
-    void pack(const Position& pos);
-
-    // sfen packed by pack() (256bit = 32bytes)
-    // Or sfen to decode with unpack()
-    uint8_t *data; // uint8_t[32];
-
-    BitStream stream;
-
-    // Output the board pieces to stream.
-    void write_board_piece_to_stream(Piece pc);
-
-    // Read one board piece from stream
-    Piece read_board_piece_from_stream();
-  };
-
-
-  // Huffman coding
-  // * is simplified from mini encoding to make conversion easier.
-  //
-  // 1 box on the board (other than NO_PIECE) = 2 to 6 bits (+ 1-bit flag + 1-bit forward and backward)
-  // 1 piece of hand piece = 1-5bit (+ 1-bit flag + 1bit ahead and behind)
-  //
-  // empty xxxxx0 + 0 (none)
-  // step xxxx01 + 2 xxxx0 + 2
-  // incense xx0011 + 2 xx001 + 2
-  // Katsura xx1011 + 2 xx101 + 2
-  // silver xx0111 + 2 xx011 + 2
-  // Gold x01111 + 1 x0111 + 1 // Gold is valid and has no flags.
-  // corner 011111 + 2 01111 + 2
-  // Fly 111111 + 2 11111 + 2
-  //
-  // Assuming all pieces are on the board,
-  // Sky 81-40 pieces = 41 boxes = 41bit
-  // Walk 4bit*18 pieces = 72bit
-  // Incense 6bit*4 pieces = 24bit
-  // Katsura 6bit*4 pieces = 24bit
-  // Silver 6bit*4 pieces = 24bit
-  // Gold 6bit* 4 pieces = 24bit
-  // corner 8bit* 2 pieces = 16bit
-  // Fly 8bit* 2 pieces = 16bit
-  // -------
-  // 241bit + 1bit (turn) + 7bit × 2 (King's position after) = 256bit
-  //
-  // When the piece on the board moves to the hand piece, the piece on the board becomes empty, so the box on the board can be expressed with 1 bit,
-  // Since the hand piece can be expressed by 1 bit less than the piece on the board, the total number of bits does not change in the end.
-  // Therefore, in this expression, any aspect can be expressed by this bit number.
-  // It is a hand piece and no flag is required, but if you include this, the bit number of the piece on the board will be -1
-  // Since the total number of bits can be fixed, we will include this as well.
-
-  // Huffman Encoding
-  //
-  // Empty  xxxxxxx0
-  // Pawn   xxxxx001 + 1 bit (Side to move)
-  // Knight xxxxx011 + 1 bit (Side to move)
-  // Bishop xxxxx101 + 1 bit (Side to move)
-  // Rook   xxxxx111 + 1 bit (Side to move)
-
-  struct HuffmanedPiece
-  {
-    int code; // how it will be coded
-    int bits; // How many bits do you have
-  };
-
-  constexpr HuffmanedPiece huffman_table[] =
-  {
-    {0b0000,1}, // NO_PIECE
-    {0b0001,4}, // PAWN
-    {0b0011,4}, // KNIGHT
-    {0b0101,4}, // BISHOP
-    {0b0111,4}, // ROOK
-    {0b1001,4}, // QUEEN
-  };
-
   // Pack sfen and store in data[32].
-  void SfenPacker::pack(const Position& pos)
+  template<typename Stream>
+  void pack(const Position& pos, uint8_t* data)
   {
-  // cout << pos;
+    Stream stream;
 
     memset(data, 0, 32 /* 256bit */);
     stream.set_data(data);
@@ -194,7 +363,7 @@ namespace Learner {
         Piece pc = pos.piece_on(make_square(f, r));
         if (type_of(pc) == KING)
           continue;
-        write_board_piece_to_stream(pc);
+        stream.write_piece(pc);
       }
     }
 
@@ -217,61 +386,27 @@ namespace Learner {
     stream.write_n_bit(1 + (pos.game_ply()-(pos.side_to_move() == BLACK)) / 2, 8);
 
     assert(stream.get_cursor() <= 256);
-  }
-
-  // Output the board pieces to stream.
-  void SfenPacker::write_board_piece_to_stream(Piece pc)
-  {
-    // piece type
-    PieceType pr = type_of(pc);
-    auto c = huffman_table[pr];
-    stream.write_n_bit(c.code, c.bits);
-
-    if (pc == NO_PIECE)
-      return;
 
-    // first and second flag
-    stream.write_one_bit(color_of(pc));
+    stream.flush();
   }
 
-  // Read one board piece from stream
-  Piece SfenPacker::read_board_piece_from_stream()
+  template<typename Stream>
+  int unpack(Position& pos, const PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror, bool lightweight)
   {
-    PieceType pr = NO_PIECE_TYPE;
-    int code = 0, bits = 0;
-    while (true)
-    {
-      code |= stream.read_one_bit() << bits;
-      ++bits;
-
-      assert(bits <= 6);
-
-      for (pr = NO_PIECE_TYPE; pr <KING; ++pr)
-        if (huffman_table[pr].code == code
-          && huffman_table[pr].bits == bits)
-          goto Found;
-    }
-  Found:;
-    if (pr == NO_PIECE_TYPE)
-      return NO_PIECE;
-
-    // first and second flag
-    Color c = (Color)stream.read_one_bit();
-
-    return make_piece(c, pr);
-  }
-
-  int set_from_packed_sfen(Position& pos, const PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror)
-  {
-    SfenPacker packer;
-    auto& stream = packer.stream;
+    Stream stream;
 
     // TODO: separate streams for writing and reading. Here we actually have to
     // const_cast which is not safe in the long run.
     stream.set_data(const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(&sfen)));
 
     pos.clear();
-    std::memset(si, 0, sizeof(StateInfo));
+
+    // The accumulator is large and is recomputed from scratch anyway, so only
+    // the fields before it are cleared.
+    std::memset(si, 0, offsetof(StateInfo, accumulator));
+    si->accumulator.computed_accumulation = false;
+    si->accumulator.computed_score = false;
+    si->dirtyPiece.dirty_num = 0;
     std::fill_n(&pos.pieceList[0][0], sizeof(pos.pieceList) / sizeof(Square), SQ_NONE);
     pos.st = si;
 
@@ -308,7 +443,9 @@ namespace Learner {
         if (type_of(pos.board[sq]) != KING)
         {
           assert(pos.board[sq] == NO_PIECE);
-          pc = packer.read_board_piece_from_stream();
+          pc = stream.read_piece();
+          if (pc == PIECE_NB)
+            return 1;
         }
         else
         {
@@ -384,6 +521,13 @@ namespace Learner {
 
     pos.chess960 = false;
     pos.thisThread = th;
+
+    if (lightweight)
+    {
+      pos.deferredState = true;
+      return 0;
+    }
+
     pos.set_state(pos.st);
 
     assert(pos.pos_is_ok());
@@ -391,16 +535,230 @@ namespace Learner {
     return 0;
   }
 
+  int set_from_packed_sfen(Position& pos, const PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror)
+  {
+    return unpack<BitStream>(pos, sfen, si, th, mirror, false);
+  }
+
+  int set_training_position(Position& pos, const PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror)
+  {
+    return unpack<BitStream>(pos, sfen, si, th, mirror, true);
+  }
+
+  int unpack_pieces(const PackedSfen& sfen, bool mirror, SfenPieces& pieces)
+  {
+    BitStream stream;
+    stream.set_data(const_cast<uint8_t*>(sfen.data));
+
+    pieces.sideToMove = (Color)stream.read_one_bit();
+
+    for (auto c : Colors)
+    {
+      const Square ksq = (Square)stream.read_n_bit(6);
+      pieces.kingSquare[c] = mirror ? flip_file(ksq) : ksq;
+    }
+
+    pieces.count = 0;
+    for (Rank r = RANK_8; r >= RANK_1; --r)
+    {
+      for (File f = FILE_A; f <= FILE_H; ++f)
+      {
+        auto sq = make_square(f, r);
+        if (mirror) {
+          sq = flip_file(sq);
+        }
+
+        if (sq == pieces.kingSquare[WHITE] || sq == pieces.kingSquare[BLACK])
+          continue;
+
+        const Piece pc = stream.read_piece();
+        if (pc == NO_PIECE)
+          continue;
+
+        // At most 30 pieces besides the kings
+        if (pc == PIECE_NB || pieces.count == 30)
+          return 1;
+
+        pieces.squares[pieces.count] = sq;
+        pieces.pieces[pieces.count++] = pc;
+      }
+    }
+
+    return stream.get_cursor() > 256;
+  }
+
   PackedSfen sfen_pack(Position& pos)
   {
     PackedSfen sfen;
 
-    SfenPacker sp;
-    sp.data = (uint8_t*)&sfen;
-    sp.pack(pos);
+    pack<BitStream>(pos, (uint8_t*)&sfen);
 
     return sfen;
   }
+  namespace {
+
+    // Read up to count records of a .bin file.
+    PSVector read_sample(const std::string& filename, size_t count)
+    {
+      PSVector sample(count);
+
+      std::ifstream fs(filename, std::ios::binary);
+      fs.read(reinterpret_cast<char*>(sample.data()), sizeof(PackedSfenValue) * count);
+      sample.resize(size_t(fs.gcount()) / sizeof(PackedSfenValue));
+
+      return sample;
+    }
+
+    // Decode every record with BitStream and the reference stream, with and
+    // without mirroring, and compare the positions. Then pack them with both
+    // and compare the bytes.
+    void test_roundtrip(const PSVector& sample)
+    {
+      Position pos, ref;
+      StateInfo si, refSi;
+      uint64_t decoded = 0, mismatches = 0, repacked = 0;
+
+      for (const auto& ps : sample)
+        for (bool mirror : { false, true })
+        {
+          const int ret = unpack<BitStream>(pos, ps.sfen, &si, Threads.main(), mirror, false);
+          const int refRet = unpack<ReferenceBitStream>(ref, ps.sfen, &refSi, Threads.main(), mirror, false);
+
+          if (ret != refRet || (!ret && pos.fen() != ref.fen()))
+          {
+            if (++mismatches <= 10)
+              cout << "decode mismatch: " << (ret ? "error" : pos.fen())
+                   << " vs " << (refRet ? "error" : ref.fen()) << endl;
+            continue;
+          }
+
+          if (ret)
+            continue;
+
+          ++decoded;
+
+          PackedSfen packed, refPacked;
+          pack<BitStream>(pos, packed.data);
+          pack<ReferenceBitStream>(ref, refPacked.data);
+
+          if (memcmp(&packed, &refPacked, sizeof(PackedSfen)))
+          {
+            if (++mismatches <= 10)
+              cout << "pack mismatch: " << pos.fen() << endl;
+            continue;
+          }
+
+          repacked += !mirror && !memcmp(&packed, &ps.sfen, sizeof(PackedSfen));
+        }
+
+      cout << sample.size() << " records, " << decoded << " decoded, "
+           << mismatches << " mismatches, " << repacked
+           << " packed back to the same bytes" << endl;
+    }
+
+    // Read all the fields of a packed sfen without setting up a position,
+    // so that the stream alone is measured. Returns a checksum of the fields.
+    template<typename Stream>
+    uint64_t scan(const PackedSfen& sfen)
+    {
+      Stream stream;
+      stream.set_data(const_cast<uint8_t*>(sfen.data));
+
+      uint64_t sum = stream.read_one_bit();
+      const int wksq = stream.read_n_bit(6), bksq = stream.read_n_bit(6);
+
+      for (int sq = 0; sq < SQUARE_NB; ++sq)
+        if (sq != wksq && sq != bksq)
+          sum = sum * 31 + stream.read_piece();
+
+      sum += stream.read_n_bit(4);
+      if (stream.read_one_bit())
+          sum += stream.read_n_bit(6);
+
+      return sum + stream.read_n_bit(6) + stream.read_n_bit(8);
+    }
+
+    // Throughput of a stream, in positions per second: reading the fields
+    // alone, decoding into a Position, the lightweight decoding used for
+    // training, and decoding followed by packing.
+    template<typename Stream>
+    void measure_speed(const PSVector& sample, int repeat, const char* name)
+    {
+      Position pos;
+      StateInfo si;
+      PackedSfen packed;
+      uint64_t checksum = 0;
+
+      TimePoint start = now();
+      for (int i = 0; i < repeat; ++i)
+        for (const auto& ps : sample)
+          checksum += scan<Stream>(ps.sfen);
+      const TimePoint scanTime = now() - start + 1;
+
+      start = now();
+      for (int i = 0; i < repeat; ++i)
+        for (const auto& ps : sample)
+        {
+          unpack<Stream>(pos, ps.sfen, &si, Threads.main(), false, false);
+          checksum += pos.key();
+        }
+      const TimePoint decodeTime = now() - start + 1;
+
+      start = now();
+      for (int i = 0; i < repeat; ++i)
+        for (const auto& ps : sample)
+        {
+          unpack<Stream>(pos, ps.sfen, &si, Threads.main(), false, true);
+          checksum += pos.piece_on(SQ_E4);
+        }
+      const TimePoint trainingTime = now() - start + 1;
+
+      start = now();
+      for (int i = 0; i < repeat; ++i)
+        for (const auto& ps : sample)
+        {
+          unpack<BitStream>(pos, ps.sfen, &si, Threads.main(), false, false);
+          pack<Stream>(pos, packed.data);
+          checksum += packed.data[i % 32];
+        }
+      const TimePoint packTime = now() - start + 1;
+
+      const uint64_t positions = uint64_t(repeat) * sample.size();
+      cout << name << ": read " << positions * 1000 / scanTime
+           << " pos/s, decode " << positions * 1000 / decodeTime
+           << " pos/s, training decode " << positions * 1000 / trainingTime
+           << " pos/s, decode + pack " << positions * 1000 / packTime
+           << " pos/s (checksum " << checksum % 1000 << ")" << endl;
+    }
+
+  } // namespace
+
+  void test_sfen_packer(std::istringstream& is)
+  {
+    std::string sub_command, filename;
+    is >> sub_command >> filename;
+
+    if (sub_command == "roundtrip" && !filename.empty())
+    {
+      size_t count = 1000000;
+      is >> count;
+      test_roundtrip(read_sample(filename, count));
+    }
+    else if (sub_command == "speed" && !filename.empty())
+    {
+      int repeat = 10;
+      is >> repeat;
+      const PSVector sample = read_sample(filename, 100000);
+      measure_speed<ReferenceBitStream>(sample, repeat, "reference");
+      measure_speed<BitStream>(sample, repeat, "word");
+    }
+    else
+    {
+      cout << "usage:" << endl;
+      cout << " test sfen roundtrip <file.bin> [count]" << endl;
+      cout << " test sfen speed <file.bin> [repeat]" << endl;
+    }
+  }
 }
 
 
@@ -8,6 +8,7 @@
 #include "learn/packed_sfen.h"
 
 #include <cstdint>
+#include <sstream>
 
 class Position;
 struct StateInfo;
@@ -15,8 +16,32 @@ class Thread;
 
 namespace Learner {
 
+    template<typename Stream>
+    int unpack(Position& pos, const PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror, bool lightweight);
+
     int set_from_packed_sfen(Position& pos, const PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror);
+    int set_training_position(Position& pos, const PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror);
+
+    // Pieces of a packed sfen, decoded without setting up a Position. Used to
+    // extract the NNUE features of a training sample directly.
+    struct SfenPieces
+    {
+        Color sideToMove;
+        Square kingSquare[COLOR_NB];
+
+        // Pieces other than the kings
+        int count;
+        Square squares[32];
+        Piece pieces[32];
+    };
+
+    // Returns non-zero if the packed sfen is invalid.
+    int unpack_pieces(const PackedSfen& sfen, bool mirror, SfenPieces& pieces);
     PackedSfen sfen_pack(Position& pos);
+
+    // "test sfen" command: checks the decoder against the reference
+    // implementation and measures its throughput.
+    void test_sfen_packer(std::istringstream& is);
 }
 
 #endif
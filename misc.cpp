@@ -39,6 +39,8 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#include <algorithm>
+#include <cctype>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -47,8 +49,15 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 #include <cstdlib>
 
 #if defined(__linux__) && !defined(__ANDROID__)
+#include <sched.h>
 #include <stdlib.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) || (defined(__GLIBCXX__) && !defined(_GLIBCXX_HAVE_ALIGNED_ALLOC) && !defined(_WIN32))
@@ -362,16 +371,64 @@ void std_aligned_free(void* ptr) {
 
 #if defined(__linux__) && !defined(__ANDROID__)
 
-void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
+namespace {
+
+std::string read_first_line(const std::string& fileName) {
+
+  std::ifstream file(fileName);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+// Mappings made by aligned_ttmem_alloc(), with their size needed by munmap()
+std::vector<std::pair<void*, size_t>> ttmemMappings;
+
+void* map_anonymous(size_t size, int flags) {
 
-  constexpr size_t alignment = 2 * 1024 * 1024; // assumed 2MB page sizes
-  size_t size = ((allocSize + alignment - 1) / alignment) * alignment; // multiple of alignment
-  if (posix_memalign(&mem, alignment, size))
-     mem = nullptr;
+  void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return mem == MAP_FAILED ? nullptr : mem;
+}
+
+} // namespace
+
+void* aligned_ttmem_alloc(size_t allocSize, void*& mem, bool largePages) {
+
+  constexpr size_t MB2 = 2 * 1024 * 1024, GB1 = 1024 * 1024 * 1024;
+  const size_t size2MB = (allocSize + MB2 - 1) / MB2 * MB2; // multiple of 2MB
+  size_t size = 0;
+  void* ret = nullptr;
+  mem = nullptr;
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+  // Explicit huge pages from the pool reserved in /proc/sys/vm/nr_hugepages or
+  // /sys/kernel/mm/hugepages. 1GB pages are used only if no memory is wasted.
+  if (largePages && allocSize % GB1 == 0)
+      mem = map_anonymous(size = allocSize, MAP_HUGETLB | (30 << MAP_HUGE_SHIFT));
+
+  if (largePages && !mem)
+      mem = map_anonymous(size = size2MB, MAP_HUGETLB | (21 << MAP_HUGE_SHIFT));
+
+  ret = mem;
+#endif
+
+  // Fall back to normal pages, 2MB aligned so that transparent huge pages
+  // can back the whole table.
+  if (!mem)
+  {
+      mem = map_anonymous(size = size2MB + MB2, 0);
+      if (!mem)
+          return nullptr;
+
+      ret = reinterpret_cast<void*>((uintptr_t(mem) + MB2 - 1) & ~uintptr_t(MB2 - 1));
 #if defined(MADV_HUGEPAGE)
-  madvise(mem, allocSize, MADV_HUGEPAGE);
+      if (largePages)
+          madvise(ret, size2MB, MADV_HUGEPAGE);
 #endif
-  return mem;
+  }
+
+  ttmemMappings.emplace_back(mem, size);
+  return ret;
 }
 
 #elif defined(_WIN64)
@@ -421,12 +478,12 @@ static void* aligned_ttmem_alloc_large_pages(size_t allocSize) {
   return mem;
 }
 
-void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
+void* aligned_ttmem_alloc(size_t allocSize, void*& mem, bool largePages) {
 
   static bool firstCall = true;
 
   // Try to allocate large pages
-  mem = aligned_ttmem_alloc_large_pages(allocSize);
+  mem = largePages ? aligned_ttmem_alloc_large_pages(allocSize) : nullptr;
 
   // Suppress info strings on the first call. The first call occurs before 'uci'
   // is received and in that case this output confuses some GUIs.
@@ -448,7 +505,7 @@ void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
 
 #else
 
-void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
+void* aligned_ttmem_alloc(size_t allocSize, void*& mem, bool) {
 
   constexpr size_t alignment = 64; // assumed cache line size
   size_t size = allocSize + alignment - 1; // allocate some extra space
@@ -475,6 +532,20 @@ void aligned_ttmem_free(void* mem) {
   }
 }
 
+#elif defined(__linux__) && !defined(__ANDROID__)
+
+void aligned_ttmem_free(void* mem) {
+
+  auto it = std::find_if(ttmemMappings.begin(), ttmemMappings.end(),
+                         [mem](const std::pair<void*, size_t>& m) { return m.first == mem; });
+
+  if (it != ttmemMappings.end())
+  {
+      munmap(it->first, it->second);
+      ttmemMappings.erase(it);
+  }
+}
+
 #else
 
 void aligned_ttmem_free(void *mem) {
@@ -484,11 +555,301 @@ void aligned_ttmem_free(void *mem) {
 #endif
 
 
-namespace WinProcGroup {
+/// aligned_ttmem_report() prints through 'info string' which pages back the
+/// memory allocated by aligned_ttmem_alloc(). Under Linux this is read from
+/// /proc/self/smaps, so it must be called after the memory has been touched
+/// to see whether transparent huge pages were actually used. Windows reports
+/// at allocation time instead.
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+void aligned_ttmem_report(void* mem) {
+
+  static bool firstCall = true;
+
+  // Suppress info strings on the first call, see the Windows version above
+  if (firstCall)
+  {
+      firstCall = false;
+      return;
+  }
+
+  auto it = std::find_if(ttmemMappings.begin(), ttmemMappings.end(),
+                         [mem](const std::pair<void*, size_t>& m) { return m.first == mem; });
+  if (it == ttmemMappings.end())
+      return;
+
+  const uintptr_t begin = uintptr_t(it->first), end = begin + it->second;
+  size_t pageSize = 0, sizeKB = 0, anonHugeKB = 0;
+  bool inside = false;
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+
+  // Sum up the areas of the mapping, which madvise() may have split
+  while (std::getline(smaps, line))
+  {
+      std::istringstream ss(line);
+      std::string field;
+      size_t value;
+
+      if (line.find('-') != std::string::npos && std::isxdigit((unsigned char)line[0]))
+      {
+          uintptr_t areaBegin = std::stoull(line, nullptr, 16);
+          inside = areaBegin >= begin && areaBegin < end;
+      }
+      else if (inside && ss >> field >> value)
+      {
+          if (field == "Size:")
+              sizeKB += value;
+          else if (field == "AnonHugePages:")
+              anonHugeKB += value;
+          else if (field == "KernelPageSize:" && !pageSize)
+              pageSize = value;
+      }
+  }
+
+  if (pageSize >= 1024 * 1024)
+      sync_cout << "info string Hash table allocation: Linux huge pages (1GB) used." << sync_endl;
+
+  else if (pageSize >= 2048)
+      sync_cout << "info string Hash table allocation: Linux huge pages (2MB) used." << sync_endl;
+
+  else if (anonHugeKB)
+      sync_cout << "info string Hash table allocation: transparent huge pages used for "
+                << 100 * anonHugeKB / std::max(sizeKB, size_t(1)) << "% of the table." << sync_endl;
+  else
+  {
+      std::string thp = read_first_line("/sys/kernel/mm/transparent_hugepage/enabled");
+      size_t open = thp.find('['), close = thp.find(']');
+      thp = open != std::string::npos && close > open ? thp.substr(open + 1, close - open - 1) : "unknown";
+
+      sync_cout << "info string Hash table allocation: normal pages used (transparent huge pages: "
+                << thp << ")." << sync_endl;
+  }
+}
+
+#else
+
+void aligned_ttmem_report(void*) {}
+
+#endif
+
+
+/// map_file() maps a whole file into memory and returns the base address, or
+/// nullptr on failure. The mapping is private: pages are shared between all
+/// processes mapping the same file until written to, which is only allowed
+/// with copyOnWrite. unmap_file() releases a mapping returned by map_file().
 
 #ifndef _WIN32
 
-void bindThisThread(size_t) {}
+void* map_file(const std::string& fileName, size_t& size, bool copyOnWrite) {
+
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd == -1)
+      return nullptr;
+
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) || statbuf.st_size <= 0)
+  {
+      ::close(fd);
+      return nullptr;
+  }
+
+  size = size_t(statbuf.st_size);
+  const int prot = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+  void* mem = mmap(nullptr, size, prot, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (mem == MAP_FAILED)
+      return nullptr;
+
+#if defined(MADV_HUGEPAGE)
+  madvise(mem, size, MADV_HUGEPAGE);
+#endif
+#if defined(MADV_WILLNEED)
+  madvise(mem, size, MADV_WILLNEED);
+#endif
+  return mem;
+}
+
+void unmap_file(void* mem, size_t size) {
+
+  if (mem)
+      munmap(mem, size);
+}
+
+#else
+
+void* map_file(const std::string& fileName, size_t& size, bool copyOnWrite) {
+
+  HANDLE fd = CreateFile(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                         OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+  if (fd == INVALID_HANDLE_VALUE)
+      return nullptr;
+
+  DWORD sizeHigh;
+  DWORD sizeLow = GetFileSize(fd, &sizeHigh);
+  size = (size_t(sizeHigh) << 16 << 16) | sizeLow;
+
+  HANDLE mmap = size ? CreateFileMapping(fd, nullptr, PAGE_READONLY, sizeHigh, sizeLow, nullptr)
+                     : nullptr;
+  CloseHandle(fd);
+  if (!mmap)
+      return nullptr;
+
+  void* mem = MapViewOfFile(mmap, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mmap); // The view keeps the mapping object alive
+  return mem;
+}
+
+void unmap_file(void* mem, size_t) {
+
+  if (mem)
+      UnmapViewOfFile(mem);
+}
+
+#endif
+
+
+namespace WinProcGroup {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+namespace {
+
+struct NumaNode {
+  std::vector<int> cores;    // First logical processor of each physical core
+  std::vector<int> siblings; // The other hardware threads of these cores
+};
+
+/// parse_cpu_list() parses a list in the kernel format, like "0-15,32-47"
+
+std::vector<int> parse_cpu_list(const std::string& list) {
+
+  std::vector<int> cpus;
+  std::istringstream ss(list);
+  std::string range;
+
+  while (std::getline(ss, range, ','))
+  {
+      size_t dash = range.find('-');
+      int first = std::atoi(range.c_str());
+      int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+
+      for (int cpu = first; cpu <= last; ++cpu)
+          cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+/// numa_nodes() reads the NUMA topology once from /sys. Only the nodes and
+/// logical processors allowed by the affinity mask of the process are kept,
+/// so running under taskset or in a cpuset behaves as expected.
+
+const std::vector<NumaNode>& numa_nodes() {
+
+  static const std::vector<NumaNode> nodes = [] {
+
+      std::vector<NumaNode> result;
+      cpu_set_t allowed;
+      if (sched_getaffinity(0, sizeof(allowed), &allowed))
+          return result;
+
+      const std::string path = "/sys/devices/system/node/";
+
+      for (int n : parse_cpu_list(read_first_line(path + "online")))
+      {
+          NumaNode node;
+
+          for (int cpu : parse_cpu_list(read_first_line(path + "node" + std::to_string(n) + "/cpulist")))
+          {
+              if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))
+                  continue;
+
+              std::vector<int> threads = parse_cpu_list(read_first_line(
+                  "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list"));
+
+              if (threads.empty() || threads.front() == cpu)
+                  node.cores.push_back(cpu);
+              else
+                  node.siblings.push_back(cpu);
+          }
+
+          if (!node.cores.empty() || !node.siblings.empty())
+              result.push_back(node);
+      }
+      return result;
+  }();
+
+  return nodes;
+}
+
+} // namespace
+
+/// best_group() returns the NUMA node for the thread with index idx, with the
+/// same policy used under Windows: physical cores of a node are filled first,
+/// then the remaining hardware threads are spread evenly across the nodes.
+/// Returns -1 if there is only one node or more threads than processors.
+
+int best_group(size_t idx) {
+
+  const std::vector<NumaNode>& nodes = numa_nodes();
+
+  if (nodes.size() < 2)
+      return -1;
+
+  std::vector<int> groups;
+  size_t siblings = 0;
+
+  for (size_t n = 0; n < nodes.size(); n++)
+  {
+      groups.insert(groups.end(), nodes[n].cores.size(), int(n));
+      siblings += nodes[n].siblings.size();
+  }
+
+  for (size_t t = 0; t < siblings; t++)
+      groups.push_back(int(t % nodes.size()));
+
+  return idx < groups.size() ? groups[idx] : -1;
+}
+
+size_t nodeCount() {
+
+  return std::max(numa_nodes().size(), size_t(1));
+}
+
+void bindThisThreadToNode(int node) {
+
+  const std::vector<NumaNode>& nodes = numa_nodes();
+
+  if (node < 0 || size_t(node) >= nodes.size())
+      return;
+
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  for (int cpu : nodes[node].cores)
+      CPU_SET(cpu, &mask);
+  for (int cpu : nodes[node].siblings)
+      CPU_SET(cpu, &mask);
+
+  sched_setaffinity(0, sizeof(mask), &mask);
+}
+
+/// bindThisThread() binds the current thread to the logical processors of
+/// its NUMA node. Memory is then allocated on that node when first touched.
+
+int bindThisThread(size_t idx) {
+
+  int node = best_group(idx);
+  bindThisThreadToNode(node);
+  return node;
+}
+
+#elif !defined(_WIN32)
+
+size_t nodeCount() { return 1; }
+void bindThisThreadToNode(int) {}
+int bindThisThread(size_t) { return -1; }
 
 #else
 
@@ -563,12 +924,9 @@ int best_group(size_t idx) {
 }
 
 
-/// bindThisThread() set the group affinity of the current thread
-
-void bindThisThread(size_t idx) {
+/// bindThisThreadToNode() set the group affinity of the current thread
 
-  // Use only local variables to be thread-safe
-  int group = best_group(idx);
+void bindThisThreadToNode(int group) {
 
   if (group == -1)
       return;
@@ -586,6 +944,20 @@ void bindThisThread(size_t idx) {
       fun3(GetCurrentThread(), &affinity, nullptr);
 }
 
+/// bindThisThread() set the group affinity of the current thread
+
+int bindThisThread(size_t idx) {
+
+  // Use only local variables to be thread-safe
+  int group = best_group(idx);
+  bindThisThreadToNode(group);
+  return group;
+}
+
+/// Per-node copies of read-only data are only made under Linux
+
+size_t nodeCount() { return 1; }
+
 #endif
 
 } // namespace WinProcGroup
@@ -37,8 +37,11 @@ void prefetch(void* addr);
 void start_logger(const std::string& fname);
 void* std_aligned_alloc(size_t alignment, size_t size);
 void std_aligned_free(void* ptr);
-void* aligned_ttmem_alloc(size_t size, void*& mem);
+void* aligned_ttmem_alloc(size_t size, void*& mem, bool largePages = true);
 void aligned_ttmem_free(void* mem); // nop if mem == nullptr
+void aligned_ttmem_report(void* mem);
+void* map_file(const std::string& fileName, size_t& size, bool copyOnWrite = false);
+void unmap_file(void* mem, size_t size); // nop if mem == nullptr
 
 void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
@@ -136,10 +139,13 @@ inline uint64_t mul_hi64(uint64_t a, uint64_t b) {
 /// logical processor group. This usually means to be limited to use max 64
 /// cores. To overcome this, some special platform specific API should be
 /// called to set group affinity for each thread. Original code from Texel by
-/// Peter Österlund.
+/// Peter Österlund. Under Linux the same functions bind threads to the NUMA
+/// nodes read from /sys, so that memory they first touch is node local.
 
 namespace WinProcGroup {
-  void bindThisThread(size_t idx);
+  int bindThisThread(size_t idx); // Returns the group/node, or -1 if not bound
+  void bindThisThreadToNode(int node);
+  size_t nodeCount();
 }
 // sleep for the specified number of milliseconds.
 extern void sleep(int ms);
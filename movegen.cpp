@@ -256,6 +256,213 @@ namespace {
     return moveList;
   }
 
+
+  // The legal generator below computes the check mask and the pins once per
+  // position and folds them into the target squares of every piece, so that
+  // only king moves and the rare en passant captures need a look at attacks.
+
+  template<Color Us>
+  ExtMove* generate_legal_pawn_moves(const Position& pos, ExtMove* moveList,
+                                     Bitboard target, Bitboard pinned, Square ksq) {
+
+    constexpr Color     Them     = ~Us;
+    constexpr Bitboard  TRank7BB = (Us == WHITE ? Rank7BB    : Rank2BB);
+    constexpr Bitboard  TRank3BB = (Us == WHITE ? Rank3BB    : Rank6BB);
+    constexpr Direction Up       = pawn_push(Us);
+    constexpr Direction UpRight  = (Us == WHITE ? NORTH_EAST : SOUTH_WEST);
+    constexpr Direction UpLeft   = (Us == WHITE ? NORTH_WEST : SOUTH_EAST);
+
+    const Square theirKsq = pos.square<KING>(Them);
+    const Bitboard emptySquares = ~pos.pieces();
+    const Bitboard enemies = pos.pieces(Them) & target;
+
+    // Pawns allowed to move in each direction: all the unpinned ones, plus the
+    // pinned ones whose pin ray runs along that direction.
+    Bitboard pushers  = pos.pieces(Us, PAWN) & ~pinned;
+    Bitboard rightCap = pushers, leftCap = pushers;
+
+    for (Bitboard b = pos.pieces(Us, PAWN) & pinned; b; )
+    {
+        Square s = pop_lsb(&b);
+        Bitboard ray = line_bb(ksq, s);
+
+        if (ray & shift<Up     >(square_bb(s))) pushers  |= s;
+        if (ray & shift<UpRight>(square_bb(s))) rightCap |= s;
+        if (ray & shift<UpLeft >(square_bb(s))) leftCap  |= s;
+    }
+
+    // Single and double pawn pushes, no promotions
+    {
+        Bitboard b1 = shift<Up>(pushers & ~TRank7BB) & emptySquares;
+        Bitboard b2 = shift<Up>(b1 & TRank3BB) & emptySquares & target;
+        b1 &= target;
+
+        while (b1)
+        {
+            Square to = pop_lsb(&b1);
+            *moveList++ = make_move(to - Up, to);
+        }
+
+        while (b2)
+        {
+            Square to = pop_lsb(&b2);
+            *moveList++ = make_move(to - Up - Up, to);
+        }
+    }
+
+    // Promotions and underpromotions
+    if (pos.pieces(Us, PAWN) & TRank7BB)
+    {
+        Bitboard b1 = shift<UpRight>(rightCap & TRank7BB) & enemies;
+        Bitboard b2 = shift<UpLeft >(leftCap  & TRank7BB) & enemies;
+        Bitboard b3 = shift<Up     >(pushers  & TRank7BB) & emptySquares & target;
+
+        while (b1)
+            moveList = make_promotions<NON_EVASIONS, UpRight>(moveList, pop_lsb(&b1), theirKsq);
+
+        while (b2)
+            moveList = make_promotions<NON_EVASIONS, UpLeft >(moveList, pop_lsb(&b2), theirKsq);
+
+        while (b3)
+            moveList = make_promotions<NON_EVASIONS, Up     >(moveList, pop_lsb(&b3), theirKsq);
+    }
+
+    // Standard captures
+    Bitboard b1 = shift<UpRight>(rightCap & ~TRank7BB) & enemies;
+    Bitboard b2 = shift<UpLeft >(leftCap  & ~TRank7BB) & enemies;
+
+    while (b1)
+    {
+        Square to = pop_lsb(&b1);
+        *moveList++ = make_move(to - UpRight, to);
+    }
+
+    while (b2)
+    {
+        Square to = pop_lsb(&b2);
+        *moveList++ = make_move(to - UpLeft, to);
+    }
+
+    // En passant captures can uncover a check along the rank of the two pawns,
+    // which no pin ray describes, so these are left to Position::legal(). The
+    // capture must still resolve a check, if any.
+    if (   pos.ep_square() != SQ_NONE
+        && (target & (pos.ep_square() | (pos.ep_square() - Up))))
+    {
+        assert(rank_of(pos.ep_square()) == relative_rank(Us, RANK_6));
+
+        b1 = pos.pieces(Us, PAWN) & pawn_attacks_bb(Them, pos.ep_square());
+
+        while (b1)
+        {
+            Move m = make<ENPASSANT>(pop_lsb(&b1), pos.ep_square());
+            if (pos.legal(m))
+                *moveList++ = m;
+        }
+    }
+
+    return moveList;
+  }
+
+
+  template<Color Us, PieceType Pt>
+  ExtMove* generate_legal_moves(const Position& pos, ExtMove* moveList,
+                                Bitboard target, Bitboard pinned, Square ksq) {
+
+    static_assert(Pt != KING && Pt != PAWN, "Unsupported piece type in generate_legal_moves()");
+
+    const Square* pl = pos.squares<Pt>(Us);
+
+    for (Square from = *pl; from != SQ_NONE; from = *++pl)
+    {
+        Bitboard b = attacks_bb<Pt>(from, pos.pieces()) & target;
+
+        // A pinned piece may only move along its pin ray
+        if (pinned & from)
+            b &= line_bb(ksq, from);
+
+        while (b)
+            *moveList++ = make_move(from, pop_lsb(&b));
+    }
+
+    return moveList;
+  }
+
+
+  template<Color Us>
+  ExtMove* generate_legal(const Position& pos, ExtMove* moveList) {
+
+    constexpr Color Them = ~Us;
+
+    const Square ksq = pos.square<KING>(Us);
+    const Bitboard checkers = pos.checkers();
+
+    // King moves, checked against the enemy attacks with the king removed from
+    // the board, so that it can't step back along the ray of a slider checker.
+    // In check they come first, as in generate<EVASIONS>.
+    auto kingMoves = [&](ExtMove* list) {
+        const Bitboard occupied = pos.pieces() ^ ksq;
+        Bitboard b = attacks_bb<KING>(ksq) & ~pos.pieces(Us);
+        while (b)
+        {
+            Square to = pop_lsb(&b);
+            if (!(pos.attackers_to(to, occupied) & pos.pieces(Them)))
+                *list++ = make_move(ksq, to);
+        }
+        return list;
+    };
+
+    if (checkers)
+    {
+        moveList = kingMoves(moveList);
+
+        if (more_than_one(checkers))
+            return moveList; // Double check, only a king move can save the day
+    }
+
+    // Squares that resolve a single check: the checker and, for a slider,
+    // the squares between it and the king.
+    const Bitboard checkMask = checkers ? between_bb(ksq, lsb(checkers)) | checkers : AllSquares;
+    const Bitboard target = ~pos.pieces(Us) & checkMask;
+    const Bitboard pinned = pos.blockers_for_king(Us) & pos.pieces(Us);
+
+    moveList = generate_legal_pawn_moves<Us>(pos, moveList, checkMask, pinned, ksq);
+    moveList = generate_legal_moves<Us, KNIGHT>(pos, moveList, target, pinned, ksq);
+    moveList = generate_legal_moves<Us, BISHOP>(pos, moveList, target, pinned, ksq);
+    moveList = generate_legal_moves<Us,   ROOK>(pos, moveList, target, pinned, ksq);
+    moveList = generate_legal_moves<Us,  QUEEN>(pos, moveList, target, pinned, ksq);
+
+    if (checkers)
+        return moveList;
+
+    moveList = kingMoves(moveList);
+
+    if (pos.can_castle(Us & ANY_CASTLING))
+        for (CastlingRights cr : { Us & KING_SIDE, Us & QUEEN_SIDE } )
+            if (!pos.castling_impeded(cr) && pos.can_castle(cr))
+            {
+                // The king path, up to its destination, must not be attacked
+                const Square rsq = pos.castling_rook_square(cr);
+                const Square kto = relative_square(Us, cr & KING_SIDE ? SQ_G1 : SQ_C1);
+                Bitboard path = between_bb(ksq, kto) | kto;
+                bool legal = true;
+
+                while (path && legal)
+                    legal = !(pos.attackers_to(pop_lsb(&path)) & pos.pieces(Them));
+
+                // In Chess960 the castling rook may have been hiding a checker
+                if (   legal
+                    && pos.is_chess960()
+                    && (attacks_bb<ROOK>(kto, pos.pieces() ^ rsq) & pos.pieces(Them, ROOK, QUEEN)))
+                    legal = false;
+
+                if (legal)
+                    *moveList++ = make<CASTLING>(ksq, rsq);
+            }
+
+    return moveList;
+  }
+
 } // namespace
 
 
@@ -344,24 +551,13 @@ ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList) {
 }
 
 
-/// generate<LEGAL> generates all the legal moves in the given position
+/// generate<LEGAL> generates all the legal moves in the given position.
+/// Pins and checks are resolved while generating, rather than by filtering
+/// the pseudo-legal moves through Position::legal().
 
 template<>
 ExtMove* generate<LEGAL>(const Position& pos, ExtMove* moveList) {
 
-  Color us = pos.side_to_move();
-  Bitboard pinned = pos.blockers_for_king(us) & pos.pieces(us);
-  Square ksq = pos.square<KING>(us);
-  ExtMove* cur = moveList;
-
-  moveList = pos.checkers() ? generate<EVASIONS    >(pos, moveList)
-                            : generate<NON_EVASIONS>(pos, moveList);
-  while (cur != moveList)
-      if (   (pinned || from_sq(*cur) == ksq || type_of(*cur) == ENPASSANT)
-          && !pos.legal(*cur))
-          *cur = (--moveList)->move;
-      else
-          ++cur;
-
-  return moveList;
+  return pos.side_to_move() == WHITE ? generate_legal<WHITE>(pos, moveList)
+                                     : generate_legal<BLACK>(pos, moveList);
 }
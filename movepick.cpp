@@ -19,6 +19,7 @@
 #include <cassert>
 
 #include "movepick.h"
+#include "thread.h"
 
 namespace {
 
@@ -145,6 +146,10 @@ Move MovePicker::select(Pred filter) {
 /// moves left, picking the move with the highest score from a list of generated moves.
 Move MovePicker::next_move(bool skipQuiets) {
 
+#if defined(USE_STATS)
+  SearchStats::Timer statsTimer(pos.this_thread()->stats.pickerTicks);
+#endif
+
 top:
   switch (stage) {
 
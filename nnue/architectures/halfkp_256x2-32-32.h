@@ -28,27 +28,27 @@
 #include "../layers/affine_transform.h"
 #include "../layers/clipped_relu.h"
 
-namespace Eval::NNUE {
+namespace Eval::NNUE::Architectures {
 
-// Input features used in evaluation function
-using RawFeatures = Features::FeatureSet<
-    Features::HalfKP<Features::Side::kFriend>>;
+  // halfkp_256x2-32-32
+  struct HalfKP_256x2_32_32 {
 
-// Number of input feature dimensions after conversion
-constexpr IndexType kTransformedFeatureDimensions = 256;
+    // Input features used in evaluation function
+    using RawFeatures = Features::FeatureSet<
+      Features::HalfKP<Features::Side::kFriend>>;
 
-namespace Layers {
+    // Number of input feature dimensions after conversion
+    static constexpr IndexType kTransformedFeatureDimensions = 256;
 
-// Define network structure
-using InputLayer = InputSlice<kTransformedFeatureDimensions * 2>;
-using HiddenLayer1 = ClippedReLU<AffineTransform<InputLayer, 32>>;
-using HiddenLayer2 = ClippedReLU<AffineTransform<HiddenLayer1, 32>>;
-using OutputLayer = AffineTransform<HiddenLayer2, 1>;
+    // Define network structure
+    using InputLayer = Layers::InputSlice<kTransformedFeatureDimensions * 2>;
+    using HiddenLayer1 = Layers::ClippedReLU<Layers::AffineTransform<InputLayer, 32>>;
+    using HiddenLayer2 = Layers::ClippedReLU<Layers::AffineTransform<HiddenLayer1, 32>>;
+    using OutputLayer = Layers::AffineTransform<HiddenLayer2, 1>;
 
-}  // namespace Layers
+    using Network = OutputLayer;
+  };
 
-using Network = Layers::OutputLayer;
-
-}  // namespace Eval::NNUE
+}  // namespace Eval::NNUE::Architectures
 
 #endif // #ifndef NNUE_HALFKP_256X2_32_32_H_INCLUDED
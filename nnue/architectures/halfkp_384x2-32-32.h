@@ -10,30 +10,27 @@
 #include "../layers/affine_transform.h"
 #include "../layers/clipped_relu.h"
 
-namespace Eval {
+namespace Eval::NNUE::Architectures {
 
-namespace NNUE {
+  // halfkp_384x2-32-32
+  struct HalfKP_384x2_32_32 {
 
-// Input features used in evaluation function
-using RawFeatures = Features::FeatureSet<
-    Features::HalfKP<Features::Side::kFriend>>;
+    // Input features used in evaluation function
+    using RawFeatures = Features::FeatureSet<
+      Features::HalfKP<Features::Side::kFriend>>;
 
-// Number of input feature dimensions after conversion
-constexpr IndexType kTransformedFeatureDimensions = 384;
+    // Number of input feature dimensions after conversion
+    static constexpr IndexType kTransformedFeatureDimensions = 384;
 
-namespace Layers {
+    // Define network structure
+    using InputLayer = Layers::InputSlice<kTransformedFeatureDimensions * 2>;
+    using HiddenLayer1 = Layers::ClippedReLU<Layers::AffineTransform<InputLayer, 32>>;
+    using HiddenLayer2 = Layers::ClippedReLU<Layers::AffineTransform<HiddenLayer1, 32>>;
+    using OutputLayer = Layers::AffineTransform<HiddenLayer2, 1>;
 
-// define network structure
-using InputLayer = InputSlice<kTransformedFeatureDimensions * 2>;
-using HiddenLayer1 = ClippedReLU<AffineTransform<InputLayer, 32>>;
-using HiddenLayer2 = ClippedReLU<AffineTransform<HiddenLayer1, 32>>;
-using OutputLayer = AffineTransform<HiddenLayer2, 1>;
+    using Network = OutputLayer;
+  };
 
-}  // namespace Layers
+}  // namespace Eval::NNUE::Architectures
 
-using Network = Layers::OutputLayer;
-
-}  // namespace NNUE
-
-}  // namespace Eval
 #endif // HALFKP_384X2_32_32_H
@@ -12,30 +12,27 @@
 #include "../layers/affine_transform.h"
 #include "../layers/clipped_relu.h"
 
-namespace Eval {
+namespace Eval::NNUE::Architectures {
 
-  namespace NNUE {
+  // k-p-cr_256x2-32-32
+  struct K_P_CR_256x2_32_32 {
 
     // Input features used in evaluation function
     using RawFeatures = Features::FeatureSet<Features::K, Features::P,
       Features::CastlingRight>;
 
     // Number of input feature dimensions after conversion
-    constexpr IndexType kTransformedFeatureDimensions = 256;
+    static constexpr IndexType kTransformedFeatureDimensions = 256;
 
-    namespace Layers {
+    // Define network structure
+    using InputLayer = Layers::InputSlice<kTransformedFeatureDimensions * 2>;
+    using HiddenLayer1 = Layers::ClippedReLU<Layers::AffineTransform<InputLayer, 32>>;
+    using HiddenLayer2 = Layers::ClippedReLU<Layers::AffineTransform<HiddenLayer1, 32>>;
+    using OutputLayer = Layers::AffineTransform<HiddenLayer2, 1>;
 
-      // define network structure
-      using InputLayer = InputSlice<kTransformedFeatureDimensions * 2>;
-      using HiddenLayer1 = ClippedReLU<AffineTransform<InputLayer, 32>>;
-      using HiddenLayer2 = ClippedReLU<AffineTransform<HiddenLayer1, 32>>;
-      using OutputLayer = AffineTransform<HiddenLayer2, 1>;
+    using Network = OutputLayer;
+  };
 
-    }  // namespace Layers
+}  // namespace Eval::NNUE::Architectures
 
-    using Network = Layers::OutputLayer;
-
-  }  // namespace NNUE
-
-}  // namespace Eval
 #endif // K_P_CR_256X2_32_32_H
@@ -18,13 +18,18 @@
 
 // Code for calculating NNUE evaluation function
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <set>
+#include <thread>
 
 #include "../evaluate.h"
 #include "../position.h"
 #include "../misc.h"
+#include "../thread.h"
 #include "../uci.h"
 
 #include "evaluate_nnue.h"
@@ -53,10 +58,14 @@ namespace Eval::NNUE {
   };
 
   // Input feature converter
-  AlignedPtr<FeatureTransformer> feature_transformer;
+  AlignedPtr<FeatureTransformer>& feature_transformer =
+      Parameters<DefaultArchitecture>::feature_transformer;
 
   // Evaluation function
-  AlignedPtr<Network> network;
+  AlignedPtr<Network>& network = Parameters<DefaultArchitecture>::network;
+
+  // Index in CompiledArchitectures of the architecture of the loaded net
+  std::size_t active_architecture = 0;
 
   // Evaluation function file name
   std::string fileName;
@@ -64,22 +73,126 @@ namespace Eval::NNUE {
   // Saved evaluation function file name
   std::string savedfileName = "nn.bin";
 
-  // Get a string that represents the structure of the evaluation function
+  // Memory mapping of the loaded net, if it was read in the mapped format
+  void* mapped_net = nullptr;
+  std::size_t mapped_net_size = 0;
+
+  // Header of a net in the mapped format. The parameter objects follow as
+  // native-endian images of the in-memory layout of this binary, so loading
+  // one is a single mmap and all processes share its page cache pages.
+  struct MappedHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t hash_value;
+    std::uint32_t byte_order;
+    std::uint32_t layout;
+    std::uint64_t feature_transformer_offset;
+    std::uint64_t feature_transformer_size;
+    std::uint64_t network_offset;
+    std::uint64_t network_size;
+  };
+
+  constexpr char kMappedMagic[8] = "NNUEMAP";
+  constexpr std::uint32_t kMappedVersion = 1;
+  constexpr std::uint32_t kMappedByteOrder = 0x01020304u;
+
+  // Layout flags of the parameter images. A net converted by a binary with a
+  // different weight order is rejected and has to be converted again.
+#if defined(USE_SPARSE_INPUT) && defined(USE_SSSE3)
+  constexpr std::uint32_t kMappedLayout = 1;
+#else
+  constexpr std::uint32_t kMappedLayout = 0;
+#endif
+
+  // The feature transformer starts on a huge page boundary, the network on
+  // a normal page boundary.
+  constexpr std::uint64_t kMappedHugePageSize = 2 * 1024 * 1024;
+  constexpr std::uint64_t kMappedPageSize = 4096;
+
+  namespace Detail {
+
+  // Get a string that represents the structure of an architecture
+  template <typename Architecture>
   std::string GetArchitectureString() {
-    return "Features=" + FeatureTransformer::GetStructureString() +
-      ",Network=" + Network::GetStructureString();
+    return "Features=" + BasicFeatureTransformer<Architecture>::GetStructureString() +
+      ",Network=" + Architecture::Network::GetStructureString();
   }
 
-  namespace Detail {
+  // Call f(Architecture()) for the architecture at the given index of the
+  // list. The candidates are tested in order, so the default architecture
+  // costs a single well predicted compare and there is no indirect call.
+  template <typename Function, typename Architecture, typename... Rest>
+  inline auto Dispatch(std::size_t index, Function&& f,
+                       ArchitectureList<Architecture, Rest...>) {
+    if constexpr (sizeof...(Rest) > 0)
+        if (index != 0)
+            return Dispatch(index - 1, f, ArchitectureList<Rest...>());
+    return f(Architecture());
+  }
+
+  template <typename Function>
+  inline auto Dispatch(std::size_t index, Function&& f) {
+    return Dispatch(index, f, CompiledArchitectures());
+  }
+
+  // Index of the architecture with the given hash value, or kSize if none
+  template <typename... ArchitectureTypes>
+  std::size_t FindArchitecture(std::uint32_t hash_value,
+                               ArchitectureList<ArchitectureTypes...>) {
+    constexpr std::uint32_t kHashValues[] = { GetHashValue<ArchitectureTypes>()... };
+    return std::find(std::begin(kHashValues), std::end(kHashValues), hash_value)
+         - std::begin(kHashValues);
+  }
 
   // Initialize the evaluation function parameters
   template <typename T>
   void Initialize(AlignedPtr<T>& pointer) {
 
     pointer.reset(reinterpret_cast<T*>(std_aligned_alloc(alignof(T), sizeof(T))));
+    pointer.get_deleter().owned = true;
     std::memset(pointer.get(), 0, sizeof(T));
   }
 
+  // Allocate a copy of the evaluation function parameters. Called from a
+  // thread bound to a NUMA node, the copy is first touched on that node.
+  template <typename T>
+  void Copy(AlignedPtr<T>& pointer, const T& source) {
+
+    pointer.reset(reinterpret_cast<T*>(std_aligned_alloc(alignof(T), sizeof(T))));
+    pointer.get_deleter().owned = true;
+    std::memcpy(static_cast<void*>(pointer.get()), &source, sizeof(T));
+  }
+
+  // Parameters to be used by a thread on the given NUMA node
+  template <typename T>
+  const T& NodeLocal(const AlignedPtr<T>& original,
+                     const std::vector<AlignedPtr<T>>& replicas, std::size_t node) {
+    return node < replicas.size() && replicas[node] ? *replicas[node] : *original;
+  }
+
+  // NUMA node of the thread evaluating pos
+  inline std::size_t NodeOf(const Position& pos) {
+    const Thread* th = pos.this_thread();
+    return th ? th->numaNode : 0;
+  }
+
+  // Point the parameters into a memory mapped net
+  template <typename T>
+  void Map(AlignedPtr<T>& pointer, char* base, std::uint64_t offset) {
+
+    pointer.reset(reinterpret_cast<T*>(base + offset));
+    pointer.get_deleter().owned = false;
+  }
+
+  // Whether a parameter image of the mapped net fits the in-memory object
+  template <typename T>
+  bool IsMappable(std::uint64_t offset, std::uint64_t size, std::size_t file_size) {
+    return size == sizeof(T)
+        && offset % alignof(T) == 0
+        && offset <= file_size
+        && size <= file_size - offset;
+  }
+
   // Read evaluation function parameters
   template <typename T>
   bool ReadParameters(std::istream& stream, const AlignedPtr<T>& pointer) {
@@ -93,18 +206,58 @@ namespace Eval::NNUE {
   // write evaluation function parameters
   template <typename T>
   bool WriteParameters(std::ostream& stream, const AlignedPtr<T>& pointer) {
-    constexpr std::uint32_t header = T::GetHashValue();
-    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_little_endian<std::uint32_t>(stream, T::GetHashValue());
     return pointer->WriteParameters(stream);
   }
 
   }  // namespace Detail
 
-  // Initialize the evaluation function parameters
+  // Get a string that represents the structure of the evaluation function
+  std::string GetArchitectureString() {
+    return Detail::GetArchitectureString<DefaultArchitecture>();
+  }
+
+  // Get the structure string of the compiled architecture with the given hash value
+  std::string GetArchitectureString(std::uint32_t hash_value) {
+    const std::size_t index = Detail::FindArchitecture(hash_value, CompiledArchitectures());
+    if (index == CompiledArchitectures::kSize)
+        return std::string();
+
+    return Detail::Dispatch(index, [](auto architecture) {
+      return Detail::GetArchitectureString<decltype(architecture)>();
+    });
+  }
+
+  // Whether the loaded net uses the default architecture
+  bool IsDefaultArchitectureActive() {
+    return active_architecture == 0;
+  }
+
+  // Release the parameters of all architectures and the mapped net, if any
+  void Release() {
+
+    for (std::size_t i = 0; i < CompiledArchitectures::kSize; ++i)
+        Detail::Dispatch(i, [](auto architecture) {
+          using Architecture = decltype(architecture);
+          Parameters<Architecture>::node_feature_transformers.clear();
+          Parameters<Architecture>::node_networks.clear();
+          Parameters<Architecture>::feature_transformer.reset();
+          Parameters<Architecture>::network.reset();
+        });
+
+    unmap_file(mapped_net, mapped_net_size);
+    mapped_net = nullptr;
+    mapped_net_size = 0;
+  }
+
+  // Initialize the evaluation function parameters. The parameters of the
+  // other architectures are released until a net that uses them is loaded.
   void Initialize() {
 
+    Release();
     Detail::Initialize(feature_transformer);
     Detail::Initialize(network);
+    active_architecture = 0;
   }
 
   // Read network header
@@ -124,10 +277,10 @@ namespace Eval::NNUE {
   // write the header
   bool WriteHeader(std::ostream& stream,
     std::uint32_t hash_value, const std::string& architecture) {
-    stream.write(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
-    stream.write(reinterpret_cast<const char*>(&hash_value), sizeof(hash_value));
+    write_little_endian(stream, kVersion);
+    write_little_endian(stream, hash_value);
     const std::uint32_t size = static_cast<std::uint32_t>(architecture.size());
-    stream.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    write_little_endian(stream, size);
     stream.write(architecture.data(), size);
     return !stream.fail();
   }
@@ -138,39 +291,170 @@ namespace Eval::NNUE {
     std::uint32_t hash_value;
     std::string architecture;
     if (!ReadHeader(stream, &hash_value, &architecture)) return false;
-    if (hash_value != kHashValue) return false;
-    if (!Detail::ReadParameters(stream, feature_transformer)) return false;
-    if (!Detail::ReadParameters(stream, network)) return false;
-    return stream && stream.peek() == std::ios::traits_type::eof();
+
+    const std::size_t index = Detail::FindArchitecture(hash_value, CompiledArchitectures());
+    if (index == CompiledArchitectures::kSize) return false;
+
+    const bool result = Detail::Dispatch(index, [&](auto arch) {
+      using Architecture = decltype(arch);
+      auto& ft = Parameters<Architecture>::feature_transformer;
+      auto& net = Parameters<Architecture>::network;
+      if (!ft) Detail::Initialize(ft);
+      if (!net) Detail::Initialize(net);
+      if (!Detail::ReadParameters(stream, ft)) return false;
+      if (!Detail::ReadParameters(stream, net)) return false;
+      return stream && stream.peek() == std::ios::traits_type::eof();
+    });
+
+    if (result)
+        active_architecture = index;
+    return result;
   }
 
   // write evaluation function parameters
   bool WriteParameters(std::ostream& stream) {
-    if (!WriteHeader(stream, kHashValue, GetArchitectureString())) return false;
-    if (!Detail::WriteParameters(stream, feature_transformer)) return false;
-    if (!Detail::WriteParameters(stream, network)) return false;
-    return !stream.fail();
+    return Detail::Dispatch(active_architecture, [&](auto arch) {
+      using Architecture = decltype(arch);
+      if (!WriteHeader(stream, GetHashValue<Architecture>(),
+                       Detail::GetArchitectureString<Architecture>())) return false;
+      if (!Detail::WriteParameters(stream, Parameters<Architecture>::feature_transformer)) return false;
+      if (!Detail::WriteParameters(stream, Parameters<Architecture>::network)) return false;
+      return !stream.fail();
+    });
+  }
+
+  // Map a net in the native-endian mapped format
+  bool ReadMappedParameters(const std::string& file_name) {
+
+    // The learner updates the parameters in place
+#if defined(EVAL_LEARN)
+    constexpr bool kCopyOnWrite = true;
+#else
+    constexpr bool kCopyOnWrite = false;
+#endif
+
+    std::size_t size = 0;
+    void* mem = map_file(file_name, size, kCopyOnWrite);
+    if (!mem) return false;
+
+    MappedHeader header;
+    if (size < sizeof(header))
+    {
+        unmap_file(mem, size);
+        return false;
+    }
+    std::memcpy(&header, mem, sizeof(header));
+
+    const std::size_t index = Detail::FindArchitecture(header.hash_value, CompiledArchitectures());
+    const bool result =
+           std::memcmp(header.magic, kMappedMagic, sizeof(kMappedMagic)) == 0
+        && header.version == kMappedVersion
+        && header.byte_order == kMappedByteOrder
+        && header.layout == kMappedLayout
+        && index != CompiledArchitectures::kSize
+        && Detail::Dispatch(index, [&](auto arch) {
+             using Architecture = decltype(arch);
+             return Detail::IsMappable<BasicFeatureTransformer<Architecture>>(
+                        header.feature_transformer_offset, header.feature_transformer_size, size)
+                 && Detail::IsMappable<typename Architecture::Network>(
+                        header.network_offset, header.network_size, size);
+           });
+
+    if (!result)
+    {
+        unmap_file(mem, size);
+        return false;
+    }
+
+    Release();
+    Detail::Dispatch(index, [&](auto arch) {
+      using Architecture = decltype(arch);
+      char* base = static_cast<char*>(mem);
+      Detail::Map(Parameters<Architecture>::feature_transformer, base, header.feature_transformer_offset);
+      Detail::Map(Parameters<Architecture>::network, base, header.network_offset);
+    });
+
+    mapped_net = mem;
+    mapped_net_size = size;
+    active_architecture = index;
+    return true;
+  }
+
+  // Write the parameters of the loaded net in the mapped format
+  bool WriteMappedParameters(std::ostream& stream) {
+    return Detail::Dispatch(active_architecture, [&](auto arch) {
+      using Architecture = decltype(arch);
+      using Transformer = BasicFeatureTransformer<Architecture>;
+      using ArchitectureNetwork = typename Architecture::Network;
+
+      MappedHeader header = {};
+      std::memcpy(header.magic, kMappedMagic, sizeof(kMappedMagic));
+      header.version = kMappedVersion;
+      header.hash_value = GetHashValue<Architecture>();
+      header.byte_order = kMappedByteOrder;
+      header.layout = kMappedLayout;
+      header.feature_transformer_offset = kMappedHugePageSize;
+      header.feature_transformer_size = sizeof(Transformer);
+      header.network_offset = CeilToMultiple(
+          header.feature_transformer_offset + header.feature_transformer_size, kMappedPageSize);
+      header.network_size = sizeof(ArchitectureNetwork);
+
+      // The gap after the header is left as a hole in the file
+      stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      stream.seekp(std::streamoff(header.feature_transformer_offset));
+      stream.write(reinterpret_cast<const char*>(Parameters<Architecture>::feature_transformer.get()),
+                   sizeof(Transformer));
+      stream.seekp(std::streamoff(header.network_offset));
+      stream.write(reinterpret_cast<const char*>(Parameters<Architecture>::network.get()),
+                   sizeof(ArchitectureNetwork));
+      return !stream.fail();
+    });
   }
 
   // Proceed with the difference calculation if possible
+  template <typename Architecture>
   static void UpdateAccumulatorIfPossible(const Position& pos) {
 
-    feature_transformer->UpdateAccumulatorIfPossible(pos);
+    Detail::NodeLocal(Parameters<Architecture>::feature_transformer,
+                      Parameters<Architecture>::node_feature_transformers,
+                      Detail::NodeOf(pos)).UpdateAccumulatorIfPossible(pos);
   }
 
   // Calculate the evaluation value
+  template <typename Architecture>
   static Value ComputeScore(const Position& pos, bool refresh) {
 
+    using Transformer = BasicFeatureTransformer<Architecture>;
+    using ArchitectureNetwork = typename Architecture::Network;
+    const std::size_t node = Detail::NodeOf(pos);
+    const auto& transformer = Detail::NodeLocal(Parameters<Architecture>::feature_transformer,
+                                                Parameters<Architecture>::node_feature_transformers, node);
+    const auto& net = Detail::NodeLocal(Parameters<Architecture>::network,
+                                        Parameters<Architecture>::node_networks, node);
+
     auto& accumulator = pos.state()->accumulator;
     if (!refresh && accumulator.computed_score) {
       return accumulator.score;
     }
 
+#if defined(USE_STATS)
+    if (!accumulator.computed_accumulation || refresh)
+    {
+        const StateInfo* prev = pos.state()->previous;
+        SearchStats& stats = pos.this_thread()->stats;
+
+        if (!refresh && prev && prev->accumulator.computed_accumulation)
+            stats.nnueUpdates++;
+        else
+            stats.nnueRefreshes++;
+    }
+#endif
+
     alignas(kCacheLineSize) TransformedFeatureType
-        transformed_features[FeatureTransformer::kBufferSize];
-    feature_transformer->Transform(pos, transformed_features, refresh);
-    alignas(kCacheLineSize) char buffer[Network::kBufferSize];
-    const auto output = network->Propagate(transformed_features, buffer);
+        transformed_features[Transformer::kBufferSize];
+    transformer.Transform(pos, transformed_features, refresh);
+    alignas(kCacheLineSize) char buffer[ArchitectureNetwork::kBufferSize];
+    const auto output = net.Propagate(transformed_features, buffer);
 
     auto score = static_cast<Value>(output[0] / FV_SCALE);
 
@@ -179,19 +463,79 @@ namespace Eval::NNUE {
     return accumulator.score;
   }
 
+  // Calculate the evaluation values of up to kMaxBatchSize positions. The
+  // transformed features and the propagation buffer of each sample share one
+  // cache-line aligned slot, so the layers can walk the batch with one stride.
+  template <typename Architecture>
+  static void ComputeScoreBatch(const Position* const* positions,
+                                std::size_t count, Value* values) {
+
+    using Transformer = BasicFeatureTransformer<Architecture>;
+    using ArchitectureNetwork = typename Architecture::Network;
+    // All the positions of a batch belong to the same thread
+    const std::size_t node = Detail::NodeOf(*positions[0]);
+    const auto& transformer = Detail::NodeLocal(Parameters<Architecture>::feature_transformer,
+                                                Parameters<Architecture>::node_feature_transformers, node);
+    const auto& net = Detail::NodeLocal(Parameters<Architecture>::network,
+                                        Parameters<Architecture>::node_networks, node);
+
+    constexpr std::size_t kFeaturesSize =
+        Transformer::kBufferSize * sizeof(TransformedFeatureType);
+    constexpr std::size_t kStride =
+        CeilToMultiple(kFeaturesSize + ArchitectureNetwork::kBufferSize, kCacheLineSize);
+
+    alignas(kCacheLineSize) char buffer[kMaxBatchSize * kStride];
+
+    // Positions whose score is already known are left out of the batch
+    IndexType batch[kMaxBatchSize];
+    IndexType batch_size = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto& accumulator = positions[i]->state()->accumulator;
+        if (accumulator.computed_score)
+            values[i] = accumulator.score;
+        else
+        {
+            transformer.Transform(*positions[i],
+                reinterpret_cast<TransformedFeatureType*>(buffer + batch_size * kStride), false);
+            batch[batch_size++] = IndexType(i);
+        }
+    }
+
+    if (batch_size == 0)
+        return;
+
+    const auto output = reinterpret_cast<const char*>(net.PropagateBatch(
+        reinterpret_cast<TransformedFeatureType*>(buffer),
+        buffer + kFeaturesSize, kStride, batch_size));
+
+    for (IndexType b = 0; b < batch_size; ++b)
+    {
+        const auto out = reinterpret_cast<const typename ArchitectureNetwork::OutputType*>(output + b * kStride);
+        auto& accumulator = positions[batch[b]]->state()->accumulator;
+        accumulator.score = static_cast<Value>(out[0] / FV_SCALE);
+        accumulator.computed_score = true;
+        values[batch[b]] = accumulator.score;
+    }
+  }
+
   // Load the evaluation function file
   bool load_eval_file(const std::string& evalFile) {
 
-    Initialize();
-
     if (Options["SkipLoadingEval"])
     {
+      Initialize();
       std::cout << "info string SkipLoadingEval set to true, Net not loaded!" << std::endl;
       return true;
     }
 
     fileName = evalFile;
 
+    if (ReadMappedParameters(evalFile))
+        return true;
+
+    Initialize();
+
     std::ifstream stream(evalFile, std::ios::binary);
 
     const bool result = ReadParameters(stream);
@@ -199,19 +543,74 @@ namespace Eval::NNUE {
     return result;
   }
 
+  // Copy the parameters of the loaded net to every NUMA node but the first,
+  // so that threads bound to a node read node-local memory, or drop the copies.
+  void replicate_eval(bool replicate) {
+
+    for (std::size_t i = 0; i < CompiledArchitectures::kSize; ++i)
+        Detail::Dispatch(i, [](auto architecture) {
+          using Architecture = decltype(architecture);
+          Parameters<Architecture>::node_feature_transformers.clear();
+          Parameters<Architecture>::node_networks.clear();
+        });
+
+    const std::size_t nodes = WinProcGroup::nodeCount();
+    if (!replicate || nodes < 2)
+        return;
+
+    Detail::Dispatch(active_architecture, [&](auto architecture) {
+      using Architecture = decltype(architecture);
+      auto& params = Parameters<Architecture>::feature_transformer;
+      auto& net = Parameters<Architecture>::network;
+      if (!params || !net)
+          return;
+
+      Parameters<Architecture>::node_feature_transformers.resize(nodes);
+      Parameters<Architecture>::node_networks.resize(nodes);
+
+      std::vector<std::thread> threads;
+      for (std::size_t n = 1; n < nodes; ++n)
+          threads.emplace_back([&, n]() {
+              WinProcGroup::bindThisThreadToNode(int(n));
+              Detail::Copy(Parameters<Architecture>::node_feature_transformers[n], *params);
+              Detail::Copy(Parameters<Architecture>::node_networks[n], *net);
+          });
+
+      for (std::thread& th : threads)
+          th.join();
+    });
+  }
+
   // Evaluation function. Perform differential calculation.
   Value evaluate(const Position& pos) {
-    return ComputeScore(pos, false);
+    return Detail::Dispatch(active_architecture, [&](auto architecture) {
+      return ComputeScore<decltype(architecture)>(pos, false);
+    });
   }
 
   // Evaluation function. Perform full calculation.
   Value compute_eval(const Position& pos) {
-    return ComputeScore(pos, true);
+    return Detail::Dispatch(active_architecture, [&](auto architecture) {
+      return ComputeScore<decltype(architecture)>(pos, true);
+    });
+  }
+
+  // Evaluation function for several positions at once. Equivalent to calling
+  // evaluate() on each of them, but the network runs layer by layer over the
+  // whole batch.
+  void evaluate_batch(const Position* const* positions, std::size_t count, Value* values) {
+    Detail::Dispatch(active_architecture, [&](auto architecture) {
+      for (std::size_t i = 0; i < count; i += kMaxBatchSize)
+          ComputeScoreBatch<decltype(architecture)>(
+              positions + i, std::min(count - i, kMaxBatchSize), values + i);
+    });
   }
 
   // Proceed with the difference calculation if possible
   void update_eval(const Position& pos) {
-    UpdateAccumulatorIfPossible(pos);
+    Detail::Dispatch(active_architecture, [&](auto architecture) {
+      UpdateAccumulatorIfPossible<decltype(architecture)>(pos);
+    });
   }
 
 } // namespace Eval::NNUE
@@ -24,17 +24,31 @@
 #include "nnue_feature_transformer.h"
 
 #include <memory>
+#include <vector>
 
 namespace Eval::NNUE {
 
+  // Hash value of the evaluation function structure of an architecture
+  template <typename Architecture>
+  constexpr std::uint32_t GetHashValue() {
+    return BasicFeatureTransformer<Architecture>::GetHashValue() ^
+           Architecture::Network::GetHashValue();
+  }
+
   // Hash value of evaluation function structure
-  constexpr std::uint32_t kHashValue =
-      FeatureTransformer::GetHashValue() ^ Network::GetHashValue();
+  constexpr std::uint32_t kHashValue = GetHashValue<DefaultArchitecture>();
+
+  // Maximum number of positions evaluated together by evaluate_batch()
+  constexpr std::size_t kMaxBatchSize = 32;
 
-  // Deleter for automating release of memory area
+  // Deleter for automating release of memory area. Parameters that point
+  // into a memory mapped net are not owned and are left alone.
   template <typename T>
   struct AlignedDeleter {
+    bool owned = true;
+
     void operator()(T* ptr) const {
+      if (!owned) return;
       ptr->~T();
       std_aligned_free(ptr);
     }
@@ -43,11 +57,24 @@ namespace Eval::NNUE {
   template <typename T>
   using AlignedPtr = std::unique_ptr<T, AlignedDeleter<T>>;
 
+  // Evaluation function parameters of one architecture. Only those of the
+  // default architecture and of the loaded net are allocated.
+  template <typename Architecture>
+  struct Parameters {
+    static inline AlignedPtr<BasicFeatureTransformer<Architecture>> feature_transformer;
+    static inline AlignedPtr<typename Architecture::Network> network;
+
+    // Copies for the threads on other NUMA nodes, indexed by node. Empty
+    // unless replicate_eval() is enabled; node 0 uses the originals.
+    static inline std::vector<AlignedPtr<BasicFeatureTransformer<Architecture>>> node_feature_transformers;
+    static inline std::vector<AlignedPtr<typename Architecture::Network>> node_networks;
+  };
+
   // Input feature converter
-  extern AlignedPtr<FeatureTransformer> feature_transformer;
+  extern AlignedPtr<FeatureTransformer>& feature_transformer;
 
   // Evaluation function
-  extern AlignedPtr<Network> network;
+  extern AlignedPtr<Network>& network;
 
   // Evaluation function file name
   extern std::string fileName;
@@ -58,6 +85,13 @@ namespace Eval::NNUE {
   // Get a string that represents the structure of the evaluation function
   std::string GetArchitectureString();
 
+  // Get the structure string of the compiled architecture with the given
+  // hash value, or an empty string if there is none
+  std::string GetArchitectureString(std::uint32_t hash_value);
+
+  // Whether the loaded net uses the default architecture
+  bool IsDefaultArchitectureActive();
+
   // read the header
   bool ReadHeader(std::istream& stream,
     std::uint32_t* hash_value, std::string* architecture);
@@ -72,6 +106,13 @@ namespace Eval::NNUE {
   // write evaluation function parameters
   bool WriteParameters(std::ostream& stream);
 
+  // Map a net in the native-endian mapped format. Returns false, leaving the
+  // current parameters untouched, if the file is not such a net for this binary.
+  bool ReadMappedParameters(const std::string& file_name);
+
+  // Write the parameters of the loaded net in the mapped format
+  bool WriteMappedParameters(std::ostream& stream);
+
 }  // namespace Eval::NNUE
 
 #endif // #ifndef NNUE_EVALUATE_NNUE_H_INCLUDED
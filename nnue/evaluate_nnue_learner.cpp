@@ -12,6 +12,7 @@
 #include "../position.h"
 #include "../uci.h"
 #include "../misc.h"
+#include "../thread.h"
 #include "../thread_win32_osx.h"
 
 #include "../eval/evaluate_common.h"
@@ -20,6 +21,7 @@
 #include "evaluate_nnue_learner.h"
 #include "trainer/features/factorizer_feature_set.h"
 #include "trainer/features/factorizer_half_kp.h"
+#include "trainer/features/factorizer_table.h"
 #include "trainer/trainer_feature_transformer.h"
 #include "trainer/trainer_input_slice.h"
 #include "trainer/trainer_affine_transform.h"
@@ -63,6 +65,130 @@ void SendMessages(std::vector<Message> messages) {
   }
 }
 
+// Convert the active base features of both perspectives, side to move
+// first, to the sorted factorized training features of an example
+void SetTrainingFeatures(const Features::IndexList active_indices[2],
+                         Example* example) {
+  using Table = Features::FactorizerTable<RawFeatures>;
+  static_assert(Features::Factorizer<RawFeatures>::GetDimensions() <
+                (1 << TrainingFeature::kIndexBits), "");
+  constexpr std::size_t kMaxIndices =
+      RawFeatures::kMaxActiveDimensions * Table::kMaxRowSize;
+
+  const Table& table = Table::Get();
+  for (const auto color : Colors) {
+    IndexType indices[kMaxIndices];
+    IndexType buffer[kMaxIndices];
+    std::size_t size = 0;
+    for (const auto base_index : active_indices[color]) {
+      size += table.Append(base_index, indices + size);
+    }
+    Table::Sort(indices, size, buffer);
+
+    // Merge the duplicates into one feature with a count
+    auto& unique_features = example->training_features[color];
+    unique_features.reserve(size);
+    for (std::size_t i = 0; i < size; ++i) {
+      if (!unique_features.empty() &&
+          indices[i] == unique_features.back().GetIndex()) {
+        unique_features.back() += TrainingFeature(indices[i]);
+      } else {
+        unique_features.emplace_back(indices[i]);
+      }
+    }
+  }
+}
+
+// Reference for SetTrainingFeatures(), the expansion by the factorizer and
+// std::sort that "test nnue training_features" checks it against
+void SetTrainingFeaturesReference(const Features::IndexList active_indices[2],
+                                  Example* example) {
+  for (const auto color : Colors) {
+    std::vector<TrainingFeature> training_features;
+    for (const auto base_index : active_indices[color]) {
+      Features::Factorizer<RawFeatures>::AppendTrainingFeatures(
+          base_index, &training_features);
+    }
+    std::sort(training_features.begin(), training_features.end());
+
+    auto& unique_features = example->training_features[color];
+    for (const auto& feature : training_features) {
+      if (!unique_features.empty() &&
+          feature.GetIndex() == unique_features.back().GetIndex()) {
+        unique_features.back() += feature;
+      } else {
+        unique_features.push_back(feature);
+      }
+    }
+  }
+}
+
+// Make the example of a position, see AddExample()
+Example MakeExample(Position& pos, Color rootColor,
+                    const Learner::PackedSfenValue& psv, double weight) {
+  Example example;
+  if (rootColor == pos.side_to_move()) {
+    example.sign = 1;
+  } else {
+    example.sign = -1;
+  }
+  example.psv = psv;
+  example.weight = weight;
+
+  Features::IndexList active_indices[2];
+  for (const auto trigger : kRefreshTriggers) {
+    RawFeatures::AppendActiveIndices(pos, trigger, active_indices);
+  }
+  if (pos.side_to_move() != WHITE) {
+    active_indices[0].swap(active_indices[1]);
+  }
+  SetTrainingFeatures(active_indices, &example);
+
+  return example;
+}
+
+// Make the example of a packed sfen without setting up a Position. The
+// HalfKP features are taken from the decoded piece list, other feature sets
+// go through a lightweight Position. Returns false if the sfen is invalid.
+bool MakeExample(const Learner::PackedSfenValue& psv, bool mirror,
+                 double weight, Example* example) {
+  example->sign = 1;
+  example->psv = psv;
+  example->weight = weight;
+
+  Features::IndexList active_indices[2];
+  if constexpr (std::is_same_v<RawFeatures,
+      Features::FeatureSet<Features::HalfKP<Features::Side::kFriend>>>) {
+    Learner::SfenPieces pieces;
+    if (Learner::unpack_pieces(psv.sfen, mirror, pieces) != 0) {
+      return false;
+    }
+
+    const Color us = pieces.sideToMove;
+    for (const Color perspective : { us, ~us }) {
+      Features::HalfKP<Features::Side::kFriend>::AppendActiveIndices(
+          pieces.kingSquare[perspective], pieces.squares, pieces.pieces,
+          pieces.count, perspective, &active_indices[perspective != us]);
+    }
+  } else {
+    Position pos;
+    StateInfo si;
+    if (pos.set_training_position(psv.sfen, &si, nullptr, mirror) != 0) {
+      return false;
+    }
+
+    for (const auto trigger : kRefreshTriggers) {
+      RawFeatures::AppendActiveIndices(pos, trigger, active_indices);
+    }
+    if (pos.side_to_move() != WHITE) {
+      active_indices[0].swap(active_indices[1]);
+    }
+  }
+  SetTrainingFeatures(active_indices, example);
+
+  return true;
+}
+
 }  // namespace
 
 // Initialize learning
@@ -71,8 +197,18 @@ void InitializeTraining(double eta1, uint64_t eta1_epoch,
   std::cout << "Initializing NN training for "
             << GetArchitectureString() << std::endl;
 
+  // The trainers only exist for the default architecture
+  if (!IsDefaultArchitectureActive()) {
+    std::cout << "Error! : the loaded net does not use the default architecture" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
   assert(feature_transformer);
   assert(network);
+
+  // Training only updates the original parameters
+  replicate_eval(false);
+
   trainer = Trainer<Network>::Create(network.get(), feature_transformer.get());
 
   if (Options["SkipLoadingEval"]) {
@@ -127,45 +263,111 @@ void RestoreParameters(const std::string& dir_name) {
 // Add 1 sample of learning data
 void AddExample(Position& pos, Color rootColor,
                 const Learner::PackedSfenValue& psv, double weight) {
+  Example example = MakeExample(pos, rootColor, psv, weight);
+
+  std::lock_guard<std::mutex> lock(examples_mutex);
+  examples.push_back(std::move(example));
+}
+
+// Add 1 sample of learning data directly from its packed sfen
+bool AddExample(const Learner::PackedSfenValue& psv, bool mirror, double weight) {
   Example example;
-  if (rootColor == pos.side_to_move()) {
-    example.sign = 1;
-  } else {
-    example.sign = -1;
+  if (!MakeExample(psv, mirror, weight, &example)) {
+    return false;
   }
-  example.psv = psv;
-  example.weight = weight;
 
-  Features::IndexList active_indices[2];
-  for (const auto trigger : kRefreshTriggers) {
-    RawFeatures::AppendActiveIndices(pos, trigger, active_indices);
-  }
-  if (pos.side_to_move() != WHITE) {
-    active_indices[0].swap(active_indices[1]);
+  std::lock_guard<std::mutex> lock(examples_mutex);
+  examples.push_back(std::move(example));
+  return true;
+}
+
+// Compare the examples made from packed sfens with the ones made through a
+// Position, and with the reference expansion, and measure their throughput
+void TestTrainingFeatures(std::istream& stream) {
+  std::string file_name;
+  stream >> file_name;
+
+  std::ifstream fs(file_name, std::ios::binary);
+  std::vector<Learner::PackedSfenValue> sample(100000);
+  fs.read(reinterpret_cast<char*>(sample.data()),
+          sizeof(Learner::PackedSfenValue) * sample.size());
+  sample.resize(std::size_t(fs.gcount()) / sizeof(Learner::PackedSfenValue));
+  if (sample.empty()) {
+    std::cout << "usage: test nnue training_features <file.bin>" << std::endl;
+    return;
   }
-  for (const auto color : Colors) {
-    std::vector<TrainingFeature> training_features;
-    for (const auto base_index : active_indices[color]) {
-      static_assert(Features::Factorizer<RawFeatures>::GetDimensions() <
-                    (1 << TrainingFeature::kIndexBits), "");
-      Features::Factorizer<RawFeatures>::AppendTrainingFeatures(
-          base_index, &training_features);
-    }
-    std::sort(training_features.begin(), training_features.end());
 
-    auto& unique_features = example.training_features[color];
-    for (const auto& feature : training_features) {
-      if (!unique_features.empty() &&
-          feature.GetIndex() == unique_features.back().GetIndex()) {
-        unique_features.back() += feature;
-      } else {
-        unique_features.push_back(feature);
+  auto same_features = [](const Example& a, const Example& b) {
+    for (const auto color : Colors) {
+      if (a.training_features[color].size() != b.training_features[color].size())
+        return false;
+      for (std::size_t i = 0; i < a.training_features[color].size(); ++i)
+        if (a.training_features[color][i].GetIndex() != b.training_features[color][i].GetIndex()
+            || a.training_features[color][i].GetCount() != b.training_features[color][i].GetCount())
+          return false;
+    }
+    return true;
+  };
+
+  // The Position path with the expansion by the factorizer and std::sort
+  auto reference_example = [](Position& pos) {
+    Example example;
+    Features::IndexList active_indices[2];
+    for (const auto trigger : kRefreshTriggers) {
+      RawFeatures::AppendActiveIndices(pos, trigger, active_indices);
+    }
+    if (pos.side_to_move() != WHITE) {
+      active_indices[0].swap(active_indices[1]);
+    }
+    SetTrainingFeaturesReference(active_indices, &example);
+    return example;
+  };
+
+  Position pos;
+  StateInfo si;
+  std::uint64_t mismatches = 0, invalid = 0;
+  for (const auto& psv : sample) {
+    for (const bool mirror : { false, true }) {
+      Example example;
+      if (!MakeExample(psv, mirror, 1.0, &example)) {
+        ++invalid;
+        continue;
       }
+      pos.set_training_position(psv.sfen, &si, Threads.main(), mirror);
+      mismatches += !same_features(example, MakeExample(pos, pos.side_to_move(), psv, 1.0))
+                 || !same_features(example, reference_example(pos));
     }
   }
 
-  std::lock_guard<std::mutex> lock(examples_mutex);
-  examples.push_back(std::move(example));
+  std::uint64_t checksum = 0;
+  TimePoint start = now();
+  for (const auto& psv : sample) {
+    pos.set_from_packed_sfen(psv.sfen, &si, Threads.main());
+    checksum += reference_example(pos).training_features[0].size();
+  }
+  const TimePoint reference_time = now() - start + 1;
+
+  start = now();
+  for (const auto& psv : sample) {
+    pos.set_from_packed_sfen(psv.sfen, &si, Threads.main());
+    checksum += MakeExample(pos, pos.side_to_move(), psv, 1.0).training_features[0].size();
+  }
+  const TimePoint position_time = now() - start + 1;
+
+  start = now();
+  for (const auto& psv : sample) {
+    Example example;
+    MakeExample(psv, false, 1.0, &example);
+    checksum += example.training_features[0].size();
+  }
+  const TimePoint direct_time = now() - start + 1;
+
+  std::cout << sample.size() << " sfens, " << mismatches << " mismatches, "
+            << invalid << " invalid" << std::endl
+            << "reference        : " << sample.size() * 1000 / reference_time << " pos/s" << std::endl
+            << "through Position : " << sample.size() * 1000 / position_time << " pos/s" << std::endl
+            << "from packed sfen : " << sample.size() * 1000 / direct_time << " pos/s" << std::endl
+            << "(checksum " << checksum << ")" << std::endl;
 }
 
 // update the evaluation function parameters
@@ -31,6 +31,16 @@ void RestoreParameters(const std::string& dir_name);
 void AddExample(Position& pos, Color rootColor,
                 const Learner::PackedSfenValue& psv, double weight);
 
+// Add 1 sample of learning data directly from its packed sfen, without
+// setting up a Position. As no search is done, the sample should be quiet.
+// Returns false if the packed sfen is invalid.
+bool AddExample(const Learner::PackedSfenValue& psv, bool mirror, double weight);
+
+// "test nnue training_features": compare the examples made from packed
+// sfens with the ones made through a Position and with the reference
+// expansion, and measure their throughput
+void TestTrainingFeatures(std::istream& stream);
+
 // update the evaluation function parameters
 void UpdateParameters(uint64_t epoch);
 
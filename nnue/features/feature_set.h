@@ -100,13 +100,24 @@ namespace Eval::NNUE::Features {
         IndexListType removed[2], IndexListType added[2], bool reset[2]) {
 
       const auto& dp = pos.state()->dirtyPiece;
-      if (dp.dirty_num == 0) return;
+      const bool king_moved = dp.dirty_num != 0 && type_of(dp.piece[0]) == KING;
 
       for (Color perspective : { WHITE, BLACK }) {
         reset[perspective] = false;
         switch (trigger) {
+          case TriggerEvent::kNone:
+            break;
           case TriggerEvent::kFriendKingMoved:
-            reset[perspective] = dp.piece[0] == make_piece(perspective, KING);
+            reset[perspective] = king_moved && color_of(dp.piece[0]) == perspective;
+            break;
+          case TriggerEvent::kEnemyKingMoved:
+            reset[perspective] = king_moved && color_of(dp.piece[0]) != perspective;
+            break;
+          case TriggerEvent::kAnyKingMoved:
+            reset[perspective] = king_moved;
+            break;
+          case TriggerEvent::kAnyPieceMoved:
+            reset[perspective] = true;
             break;
           default:
             assert(false);
@@ -49,6 +49,17 @@ namespace Eval::NNUE::Features {
     }
   }
 
+  // Get a list of indices for active features from a list of pieces
+  template <Side AssociatedKing>
+  void HalfKP<AssociatedKing>::AppendActiveIndices(
+      Square ksq, const Square* squares, const Piece* pieces, int count,
+      Color perspective, IndexList* active) {
+
+    ksq = orient(perspective, ksq);
+    for (int i = 0; i < count; ++i)
+      active->push_back(MakeIndex(perspective, squares[i], pieces[i], ksq));
+  }
+
   // Get a list of indices for recently changed features
   template <Side AssociatedKing>
   void HalfKP<AssociatedKing>::AppendChangedIndices(
@@ -49,6 +49,12 @@ namespace Eval::NNUE::Features {
     static void AppendActiveIndices(const Position& pos, Color perspective,
                                     IndexList* active);
 
+    // Get a list of indices for active features from the king square and the
+    // other pieces, without a Position (used to train from packed sfens)
+    static void AppendActiveIndices(Square ksq, const Square* squares,
+                                    const Piece* pieces, int count,
+                                    Color perspective, IndexList* active);
+
     // Get a list of indices for recently changed features
     static void AppendChangedIndices(const Position& pos, Color perspective,
                                      IndexList* removed, IndexList* added);
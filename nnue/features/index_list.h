@@ -56,7 +56,7 @@ namespace Eval::NNUE::Features {
 
   //Type of feature index list
   class IndexList
-      : public ValueList<IndexType, RawFeatures::kMaxActiveDimensions> {
+      : public ValueList<IndexType, CompiledArchitectures::kMaxActiveDimensions> {
   };
 
 }  // namespace Eval::NNUE::Features
@@ -22,6 +22,7 @@
 #define NNUE_LAYERS_AFFINE_TRANSFORM_H_INCLUDED
 
 #include <iostream>
+#include "../../bitboard.h"
 #include "../nnue_common.h"
 
 namespace Eval::NNUE::Layers {
@@ -42,6 +43,17 @@ namespace Eval::NNUE::Layers {
     static constexpr IndexType kPaddedInputDimensions =
         CeilToMultiple<IndexType>(kInputDimensions, kMaxSimdWidth);
 
+    // The layer that reads the transformed features directly sees mostly zero
+    // inputs after clamping, so it skips the zero 4-byte input blocks. Its
+    // weights are then stored column-major in groups of 4 inputs.
+  #if defined(USE_SPARSE_INPUT) && defined(USE_SSSE3)
+    static constexpr bool kSparseInput =
+        PreviousLayer::kBufferSize == 0 &&
+        kOutputDimensions % (kSimdWidth / sizeof(OutputType)) == 0;
+  #else
+    static constexpr bool kSparseInput = false;
+  #endif
+
     // Size of forward propagation buffer used in this layer
     static constexpr std::size_t kSelfBufferSize =
         CeilToMultiple(kOutputDimensions * sizeof(OutputType), kCacheLineSize);
@@ -67,24 +79,49 @@ namespace Eval::NNUE::Layers {
         PreviousLayer::GetStructureString() + ")";
     }
     
+    // Position in weights_ of the weight from input j to output i. The file
+    // format is always row-major, the in-memory layout depends on kSparseInput.
+    static constexpr IndexType GetWeightIndex(IndexType i, IndexType j) {
+      return kSparseInput
+          ? (j / 4 * kOutputDimensions + i) * 4 + j % 4
+          : i * kPaddedInputDimensions + j;
+    }
+
    // Read network parameters
     bool ReadParameters(std::istream& stream) {
       if (!previous_layer_.ReadParameters(stream)) return false;
-      for (std::size_t i = 0; i < kOutputDimensions; ++i)
-        biases_[i] = read_little_endian<BiasType>(stream);
-      for (std::size_t i = 0; i < kOutputDimensions * kPaddedInputDimensions; ++i)
-        weights_[i] = read_little_endian<WeightType>(stream);
+      read_little_endian(stream, biases_, kOutputDimensions);
+      if (kSparseInput)
+      {
+        WeightType row[kPaddedInputDimensions];
+        for (IndexType i = 0; i < kOutputDimensions; ++i)
+        {
+          read_little_endian(stream, row, kPaddedInputDimensions);
+          for (IndexType j = 0; j < kPaddedInputDimensions; ++j)
+            weights_[GetWeightIndex(i, j)] = row[j];
+        }
+      }
+      else
+        read_little_endian(stream, weights_, kOutputDimensions * kPaddedInputDimensions);
       return !stream.fail();
     }
 
     // write parameters
     bool WriteParameters(std::ostream& stream) const {
       if (!previous_layer_.WriteParameters(stream)) return false;
-      stream.write(reinterpret_cast<const char*>(biases_),
-        kOutputDimensions * sizeof(BiasType));
-      stream.write(reinterpret_cast<const char*>(weights_),
-        kOutputDimensions * kPaddedInputDimensions *
-        sizeof(WeightType));
+      write_little_endian(stream, biases_, kOutputDimensions);
+      if (kSparseInput)
+      {
+        WeightType row[kPaddedInputDimensions];
+        for (IndexType i = 0; i < kOutputDimensions; ++i)
+        {
+          for (IndexType j = 0; j < kPaddedInputDimensions; ++j)
+            row[j] = weights_[GetWeightIndex(i, j)];
+          write_little_endian(stream, row, kPaddedInputDimensions);
+        }
+      }
+      else
+        write_little_endian(stream, weights_, kOutputDimensions * kPaddedInputDimensions);
       return !stream.fail();
     }
 
@@ -94,6 +131,87 @@ namespace Eval::NNUE::Layers {
       const auto input = previous_layer_.Propagate(
           transformed_features, buffer + kSelfBufferSize);
       const auto output = reinterpret_cast<OutputType*>(buffer);
+      Compute(input, output);
+      return output;
+    }
+
+    // Forward propagation of a batch. The transformed features and the buffer
+    // of sample b are located b * stride bytes after those of sample 0. Each
+    // layer runs over the whole batch before the next one, so its weights are
+    // loaded into cache once per batch instead of once per sample.
+    const OutputType* PropagateBatch(
+        const TransformedFeatureType* transformed_features, char* buffer,
+        std::size_t stride, IndexType batch_size) const {
+      const auto input = reinterpret_cast<const char*>(
+          previous_layer_.PropagateBatch(transformed_features,
+              buffer + kSelfBufferSize, stride, batch_size));
+      IndexType b = 0;
+  #if defined(USE_AVX2) && !defined(USE_AVX512)
+      if constexpr (!kSparseInput)
+        for (; b + 4 <= batch_size; b += 4)
+          ComputeBatch4(input + b * stride, buffer + b * stride, stride);
+  #endif
+      for (; b < batch_size; ++b)
+        Compute(reinterpret_cast<const InputType*>(input + b * stride),
+                reinterpret_cast<OutputType*>(buffer + b * stride));
+      return reinterpret_cast<OutputType*>(buffer);
+    }
+
+   private:
+    using BiasType = OutputType;
+    using WeightType = std::int8_t;
+
+  #if defined(USE_AVX2) && !defined(USE_AVX512)
+    // Compute the outputs of four samples at once. Each weight row is loaded
+    // once and multiplied with the inputs of all four samples.
+    void ComputeBatch4(const char* input, char* buffer, std::size_t stride) const {
+      constexpr IndexType kNumChunks = kPaddedInputDimensions / kSimdWidth;
+  #if !defined(USE_VNNI)
+      const __m256i kOnes = _mm256_set1_epi16(1);
+  #endif
+      const __m256i* input_vector[4];
+      OutputType* output[4];
+      for (int k = 0; k < 4; ++k) {
+        input_vector[k] = reinterpret_cast<const __m256i*>(input + k * stride);
+        output[k] = reinterpret_cast<OutputType*>(buffer + k * stride);
+      }
+
+      for (IndexType i = 0; i < kOutputDimensions; ++i) {
+        const auto row = reinterpret_cast<const __m256i*>(&weights_[i * kPaddedInputDimensions]);
+        __m256i sum[4] = { _mm256_setzero_si256(), _mm256_setzero_si256(),
+                           _mm256_setzero_si256(), _mm256_setzero_si256() };
+        for (IndexType j = 0; j < kNumChunks; ++j) {
+          const __m256i w = _mm256_load_si256(&row[j]);
+          for (int k = 0; k < 4; ++k) {
+  #if defined(USE_VNNI)
+            sum[k] = _mm256_dpbusd_epi32(sum[k], _mm256_loadA_si256(&input_vector[k][j]), w);
+  #else
+            __m256i product = _mm256_maddubs_epi16(_mm256_loadA_si256(&input_vector[k][j]), w);
+            product = _mm256_madd_epi16(product, kOnes);
+            sum[k] = _mm256_add_epi32(sum[k], product);
+  #endif
+          }
+        }
+        // Horizontal sums of the four accumulators end up in one register
+        const __m256i sum0123 = _mm256_hadd_epi32(
+            _mm256_hadd_epi32(sum[0], sum[1]), _mm256_hadd_epi32(sum[2], sum[3]));
+        const __m128i sum128 = _mm_add_epi32(
+            _mm256_castsi256_si128(sum0123), _mm256_extracti128_si256(sum0123, 1));
+        output[0][i] = _mm_cvtsi128_si32(sum128) + biases_[i];
+        output[1][i] = _mm_extract_epi32(sum128, 1) + biases_[i];
+        output[2][i] = _mm_extract_epi32(sum128, 2) + biases_[i];
+        output[3][i] = _mm_extract_epi32(sum128, 3) + biases_[i];
+      }
+    }
+  #endif
+
+    // Compute the output of this layer from the output of the previous one
+    void Compute(const InputType* input, OutputType* output) const {
+
+      if constexpr (kSparseInput) {
+        PropagateSparse(input, output);
+        return;
+      }
 
   #if defined(USE_AVX512)
       constexpr IndexType kNumChunks = kPaddedInputDimensions / (kSimdWidth * 2);
@@ -266,12 +384,95 @@ namespace Eval::NNUE::Layers {
   #if defined(USE_MMX)
       _mm_empty();
   #endif
-      return output;
     }
 
-   private:
-    using BiasType = OutputType;
-    using WeightType = std::int8_t;
+    // Forward propagation of the sparse input layer. The indices of the
+    // non-zero 4-byte input blocks are collected first, then only the weight
+    // columns of those blocks are accumulated into the outputs.
+    void PropagateSparse(const InputType* input, OutputType* output) const {
+  #if defined(USE_SPARSE_INPUT) && defined(USE_SSSE3)
+      constexpr IndexType kNumChunks = kPaddedInputDimensions / kSimdWidth;
+      constexpr IndexType kBlocksPerChunk = kSimdWidth / 4;
+      constexpr IndexType kNumRegs = kOutputDimensions / kBlocksPerChunk;
+      const auto input32 = reinterpret_cast<const std::int32_t*>(input);
+      std::uint16_t nnz[kPaddedInputDimensions / 4];
+      IndexType count = 0;
+
+  #if defined(USE_AVX2)
+      const auto input_vector = reinterpret_cast<const __m256i*>(input);
+      const __m256i kZero = _mm256_setzero_si256();
+  #if !defined(USE_VNNI)
+      const __m256i kOnes = _mm256_set1_epi16(1);
+  #endif
+      for (IndexType i = 0; i < kNumChunks; ++i) {
+        // Inputs are clamped to [0, 127], so a block is non-zero iff it is positive
+        Bitboard mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_cmpgt_epi32(_mm256_loadA_si256(&input_vector[i]), kZero)));
+        while (mask)
+          nnz[count++] = std::uint16_t(i * kBlocksPerChunk + pop_lsb(&mask));
+      }
+
+      __m256i sum[kNumRegs];
+      const auto bias = reinterpret_cast<const __m256i*>(biases_);
+      for (IndexType k = 0; k < kNumRegs; ++k)
+        sum[k] = _mm256_loadA_si256(&bias[k]);
+
+      for (IndexType i = 0; i < count; ++i) {
+        const __m256i in = _mm256_set1_epi32(input32[nnz[i]]);
+        const auto col = reinterpret_cast<const __m256i*>(
+            &weights_[GetWeightIndex(0, nnz[i] * 4)]);
+        for (IndexType k = 0; k < kNumRegs; ++k) {
+  #if defined(USE_VNNI)
+          sum[k] = _mm256_dpbusd_epi32(sum[k], in, _mm256_load_si256(&col[k]));
+  #else
+          __m256i product = _mm256_maddubs_epi16(in, _mm256_load_si256(&col[k]));
+          product = _mm256_madd_epi16(product, kOnes);
+          sum[k] = _mm256_add_epi32(sum[k], product);
+  #endif
+        }
+      }
+
+      const auto out = reinterpret_cast<__m256i*>(output);
+      for (IndexType k = 0; k < kNumRegs; ++k)
+        _mm256_storeA_si256(&out[k], sum[k]);
+
+  #else
+      const auto input_vector = reinterpret_cast<const __m128i*>(input);
+      const __m128i kZero = _mm_setzero_si128();
+      const __m128i kOnes = _mm_set1_epi16(1);
+      for (IndexType i = 0; i < kNumChunks; ++i) {
+        Bitboard mask = _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_cmpgt_epi32(_mm_load_si128(&input_vector[i]), kZero)));
+        while (mask)
+          nnz[count++] = std::uint16_t(i * kBlocksPerChunk + pop_lsb(&mask));
+      }
+
+      __m128i sum[kNumRegs];
+      const auto bias = reinterpret_cast<const __m128i*>(biases_);
+      for (IndexType k = 0; k < kNumRegs; ++k)
+        sum[k] = _mm_load_si128(&bias[k]);
+
+      for (IndexType i = 0; i < count; ++i) {
+        const __m128i in = _mm_set1_epi32(input32[nnz[i]]);
+        const auto col = reinterpret_cast<const __m128i*>(
+            &weights_[GetWeightIndex(0, nnz[i] * 4)]);
+        for (IndexType k = 0; k < kNumRegs; ++k) {
+          __m128i product = _mm_maddubs_epi16(in, _mm_load_si128(&col[k]));
+          product = _mm_madd_epi16(product, kOnes);
+          sum[k] = _mm_add_epi32(sum[k], product);
+        }
+      }
+
+      const auto out = reinterpret_cast<__m128i*>(output);
+      for (IndexType k = 0; k < kNumRegs; ++k)
+        _mm_store_si128(&out[k], sum[k]);
+  #endif
+
+  #else
+      (void)input;
+      (void)output;
+  #endif
+    }
 
     // Make the learning class a friend
     friend class Trainer<AffineTransform>;
@@ -77,6 +77,26 @@ namespace Eval::NNUE::Layers {
       const auto input = previous_layer_.Propagate(
           transformed_features, buffer + kSelfBufferSize);
       const auto output = reinterpret_cast<OutputType*>(buffer);
+      Compute(input, output);
+      return output;
+    }
+
+    // Forward propagation of a batch, see AffineTransform::PropagateBatch()
+    const OutputType* PropagateBatch(
+        const TransformedFeatureType* transformed_features, char* buffer,
+        std::size_t stride, IndexType batch_size) const {
+      const auto input = reinterpret_cast<const char*>(
+          previous_layer_.PropagateBatch(transformed_features,
+              buffer + kSelfBufferSize, stride, batch_size));
+      for (IndexType b = 0; b < batch_size; ++b)
+        Compute(reinterpret_cast<const InputType*>(input + b * stride),
+                reinterpret_cast<OutputType*>(buffer + b * stride));
+      return reinterpret_cast<OutputType*>(buffer);
+    }
+
+   private:
+    // Compute the output of this layer from the output of the previous one
+    void Compute(const InputType* input, OutputType* output) const {
 
   #if defined(USE_AVX2)
       constexpr IndexType kNumChunks = kInputDimensions / kSimdWidth;
@@ -166,10 +186,8 @@ namespace Eval::NNUE::Layers {
         output[i] = static_cast<OutputType>(
             std::max(0, std::min(127, input[i] >> kWeightScaleBits)));
       }
-      return output;
     }
 
-   private:
      // Make the learning class a friend
      friend class Trainer<ClippedReLU>;
      
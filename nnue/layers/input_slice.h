@@ -72,6 +72,13 @@ class InputSlice {
     return transformed_features + Offset;
   }
 
+  // Forward propagation of a batch
+  const OutputType* PropagateBatch(
+      const TransformedFeatureType* transformed_features, char* /*buffer*/,
+      std::size_t /*stride*/, IndexType /*batch_size*/) const {
+    return transformed_features + Offset;
+  }
+
  private:
 };
 
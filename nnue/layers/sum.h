@@ -78,6 +78,24 @@ class Sum : public Sum<RemainingPreviousLayers...> {
     return output;
   }
 
+  // forward propagation of a batch
+  const OutputType* PropagateBatch(
+      const TransformedFeatureType* transformed_features, char* buffer,
+      std::size_t stride, IndexType batch_size) const {
+    Tail::PropagateBatch(transformed_features, buffer, stride, batch_size);
+    const auto head_output = reinterpret_cast<const char*>(
+        previous_layer_.PropagateBatch(transformed_features,
+            buffer + kSelfBufferSize, stride, batch_size));
+    for (IndexType b = 0; b < batch_size; ++b) {
+      const auto head = reinterpret_cast<const OutputType*>(head_output + b * stride);
+      const auto output = reinterpret_cast<OutputType*>(buffer + b * stride);
+      for (IndexType i = 0; i < kOutputDimensions; ++i) {
+        output[i] += head[i];
+      }
+    }
+    return reinterpret_cast<OutputType*>(buffer);
+  }
+
  protected:
   // A string that represents the list of layers to be summed
   static std::string GetSummandsString() {
@@ -137,6 +155,14 @@ class Sum<PreviousLayer> {
     return previous_layer_.Propagate(transformed_features, buffer);
   }
 
+  // forward propagation of a batch
+  const OutputType* PropagateBatch(
+      const TransformedFeatureType* transformed_features, char* buffer,
+      std::size_t stride, IndexType batch_size) const {
+    return previous_layer_.PropagateBatch(
+        transformed_features, buffer, stride, batch_size);
+  }
+
  protected:
   // A string that represents the list of layers to be summed
   static std::string GetSummandsString() {
@@ -25,10 +25,11 @@
 
 namespace Eval::NNUE {
 
-  // Class that holds the result of affine transformation of input features
+  // Class that holds the result of affine transformation of input features.
+  // The feature transformer of the active net places its rows, so the part
+  // used by the default net is as large as with a single architecture.
   struct alignas(kCacheLineSize) Accumulator {
-    std::int16_t
-        accumulation[2][kRefreshTriggers.size()][kTransformedFeatureDimensions];
+    std::int16_t accumulation[CompiledArchitectures::kMaxAccumulationSize];
     Value score;
     bool computed_accumulation;
     bool computed_score;
@@ -21,14 +21,58 @@
 #ifndef NNUE_ARCHITECTURE_H_INCLUDED
 #define NNUE_ARCHITECTURE_H_INCLUDED
 
-// Defines the network structure
+// Defines the network structures
 #include "architectures/halfkp_256x2-32-32.h"
+#include "architectures/halfkp_384x2-32-32.h"
+#include "architectures/halfkp-cr-ep_256x2-32-32.h"
+#include "architectures/k-p_256x2-32-32.h"
+#include "architectures/k-p-cr_256x2-32-32.h"
+#include "architectures/k-p-cr-ep_256x2-32-32.h"
+
+#include <algorithm>
 
 namespace Eval::NNUE {
 
-  static_assert(kTransformedFeatureDimensions % kMaxSimdWidth == 0, "");
-  static_assert(Network::kOutputDimensions == 1, "");
-  static_assert(std::is_same<Network::OutputType, std::int32_t>::value, "");
+  // List of architectures compiled into the binary
+  template <typename... ArchitectureTypes>
+  struct ArchitectureList {
+    static constexpr std::size_t kSize = sizeof...(ArchitectureTypes);
+
+    // Largest sizes over all the architectures, used by the accumulator and
+    // the feature index lists that are shared between them. The accumulator
+    // holds one row per perspective and refresh trigger.
+    static constexpr IndexType kMaxAccumulationSize =
+        std::max({IndexType(2 * ArchitectureTypes::RawFeatures::kRefreshTriggers.size()
+                              * ArchitectureTypes::kTransformedFeatureDimensions)...});
+    static constexpr IndexType kMaxActiveDimensions =
+        std::max({ArchitectureTypes::RawFeatures::kMaxActiveDimensions...});
+
+    static_assert(((ArchitectureTypes::kTransformedFeatureDimensions % kMaxSimdWidth == 0) && ...), "");
+    static_assert(((ArchitectureTypes::Network::kOutputDimensions == 1) && ...), "");
+    static_assert((std::is_same<typename ArchitectureTypes::Network::OutputType, std::int32_t>::value && ...), "");
+  };
+
+  // Architectures a net can be evaluated with. load_eval_file() selects the
+  // one whose hash value matches the file, the first one is the default.
+  using CompiledArchitectures = ArchitectureList<
+      Architectures::HalfKP_256x2_32_32,
+      Architectures::HalfKP_384x2_32_32,
+      Architectures::HalfKP_CR_EP_256x2_32_32,
+      Architectures::K_P_256x2_32_32,
+      Architectures::K_P_CR_256x2_32_32,
+      Architectures::K_P_CR_EP_256x2_32_32>;
+
+  // Architecture used for training and for newly created nets
+  using DefaultArchitecture = Architectures::HalfKP_256x2_32_32;
+
+  // Input features used in evaluation function
+  using RawFeatures = DefaultArchitecture::RawFeatures;
+
+  // Number of input feature dimensions after conversion
+  constexpr IndexType kTransformedFeatureDimensions =
+      DefaultArchitecture::kTransformedFeatureDimensions;
+
+  using Network = DefaultArchitecture::Network;
 
   // Trigger for full calculation instead of difference calculation
   constexpr auto kRefreshTriggers = RawFeatures::kRefreshTriggers;
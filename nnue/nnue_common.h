@@ -21,6 +21,7 @@
 #ifndef NNUE_COMMON_H_INCLUDED
 #define NNUE_COMMON_H_INCLUDED
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 
@@ -147,6 +148,66 @@ namespace Eval::NNUE {
       return result;
   }
 
+  // Whether the compiling machine stores integers in little-endian order.
+  // The compiler folds this to a constant.
+  inline bool IsLittleEndian() {
+
+      const std::uint16_t probe = 1;
+      std::uint8_t first_byte;
+      std::memcpy(&first_byte, &probe, 1);
+      return first_byte == 1;
+  }
+
+  // Reverse the byte order of an integer
+  template <typename IntType>
+  inline IntType swap_bytes(IntType value) {
+
+      std::uint8_t u[sizeof(IntType)];
+      std::memcpy(u, &value, sizeof(IntType));
+      std::reverse(u, u + sizeof(IntType));
+      std::memcpy(&value, u, sizeof(IntType));
+      return value;
+  }
+
+  // Read an array of count integers in little-endian order. The whole block is
+  // read at once and only big-endian machines need a byte swap pass over it.
+  template <typename IntType>
+  inline void read_little_endian(std::istream& stream, IntType* out, std::size_t count) {
+
+      stream.read(reinterpret_cast<char*>(out), sizeof(IntType) * count);
+      if (sizeof(IntType) > 1 && !IsLittleEndian())
+          for (std::size_t i = 0; i < count; ++i)
+              out[i] = swap_bytes(out[i]);
+  }
+
+  // write_little_endian() is the counterpart of read_little_endian() for an
+  // integer or an array of count integers. Little-endian machines write the
+  // array in one block, big-endian ones swap it chunk by chunk.
+  template <typename IntType>
+  inline void write_little_endian(std::ostream& stream, const IntType* values, std::size_t count) {
+
+      if (sizeof(IntType) == 1 || IsLittleEndian())
+      {
+          stream.write(reinterpret_cast<const char*>(values), sizeof(IntType) * count);
+          return;
+      }
+
+      constexpr std::size_t kChunkSize = 4096;
+      IntType chunk[kChunkSize];
+      for (std::size_t i = 0; i < count; i += kChunkSize)
+      {
+          const std::size_t n = std::min(count - i, kChunkSize);
+          for (std::size_t j = 0; j < n; ++j)
+              chunk[j] = swap_bytes(values[i + j]);
+          stream.write(reinterpret_cast<const char*>(chunk), sizeof(IntType) * n);
+      }
+  }
+
+  template <typename IntType>
+  inline void write_little_endian(std::ostream& stream, IntType value) {
+      write_little_endian(stream, &value, 1);
+  }
+
 }  // namespace Eval::NNUE
 
 #endif // #ifndef NNUE_COMMON_H_INCLUDED
@@ -30,11 +30,17 @@
 namespace Eval::NNUE {
 
   // Input feature converter
-  class FeatureTransformer {
+  template <typename Architecture>
+  class BasicFeatureTransformer {
 
    private:
+    // Input features and the timings of their full calculation
+    using RawFeatures = typename Architecture::RawFeatures;
+    static constexpr auto kRefreshTriggers = RawFeatures::kRefreshTriggers;
+
     // Number of output dimensions for one side
-    static constexpr IndexType kHalfDimensions = kTransformedFeatureDimensions;
+    static constexpr IndexType kHalfDimensions =
+        Architecture::kTransformedFeatureDimensions;
 
    public:
     // Output type
@@ -62,19 +68,15 @@ namespace Eval::NNUE {
 
     // Read network parameters
     bool ReadParameters(std::istream& stream) {
-      for (std::size_t i = 0; i < kHalfDimensions; ++i)
-        biases_[i] = read_little_endian<BiasType>(stream);
-      for (std::size_t i = 0; i < kHalfDimensions * kInputDimensions; ++i)
-        weights_[i] = read_little_endian<WeightType>(stream);
+      read_little_endian(stream, biases_, kHalfDimensions);
+      read_little_endian(stream, weights_, kHalfDimensions * kInputDimensions);
       return !stream.fail();
     }
 
     // write parameters
     bool WriteParameters(std::ostream& stream) const {
-      stream.write(reinterpret_cast<const char*>(biases_),
-        kHalfDimensions * sizeof(BiasType));
-      stream.write(reinterpret_cast<const char*>(weights_),
-        kHalfDimensions * kInputDimensions * sizeof(WeightType));
+      write_little_endian(stream, biases_, kHalfDimensions);
+      write_little_endian(stream, weights_, kHalfDimensions * kInputDimensions);
       return !stream.fail();
     }
 
@@ -97,7 +99,7 @@ namespace Eval::NNUE {
       if (refresh || !UpdateAccumulatorIfPossible(pos)) {
         RefreshAccumulator(pos);
       }
-      const auto& accumulation = pos.state()->accumulator.accumulation;
+      const auto& accumulator = pos.state()->accumulator;
 
   #if defined(USE_AVX2)
       constexpr IndexType kNumChunks = kHalfDimensions / kSimdWidth;
@@ -130,9 +132,15 @@ namespace Eval::NNUE {
         auto out = reinterpret_cast<__m256i*>(&output[offset]);
         for (IndexType j = 0; j < kNumChunks; ++j) {
           __m256i sum0 = _mm256_loadA_si256(
-              &reinterpret_cast<const __m256i*>(accumulation[perspectives[p]][0])[j * 2 + 0]);
+              &reinterpret_cast<const __m256i*>(Row(accumulator, perspectives[p], 0))[j * 2 + 0]);
           __m256i sum1 = _mm256_loadA_si256(
-            &reinterpret_cast<const __m256i*>(accumulation[perspectives[p]][0])[j * 2 + 1]);
+            &reinterpret_cast<const __m256i*>(Row(accumulator, perspectives[p], 0))[j * 2 + 1]);
+          for (IndexType i = 1; i < kRefreshTriggers.size(); ++i) {
+            sum0 = _mm256_add_epi16(sum0, _mm256_loadA_si256(
+                &reinterpret_cast<const __m256i*>(Row(accumulator, perspectives[p], i))[j * 2 + 0]));
+            sum1 = _mm256_add_epi16(sum1, _mm256_loadA_si256(
+                &reinterpret_cast<const __m256i*>(Row(accumulator, perspectives[p], i))[j * 2 + 1]));
+          }
           _mm256_storeA_si256(&out[j], _mm256_permute4x64_epi64(_mm256_max_epi8(
               _mm256_packs_epi16(sum0, sum1), kZero), kControl));
         }
@@ -141,9 +149,15 @@ namespace Eval::NNUE {
         auto out = reinterpret_cast<__m128i*>(&output[offset]);
         for (IndexType j = 0; j < kNumChunks; ++j) {
           __m128i sum0 = _mm_load_si128(&reinterpret_cast<const __m128i*>(
-              accumulation[perspectives[p]][0])[j * 2 + 0]);
+              Row(accumulator, perspectives[p], 0))[j * 2 + 0]);
           __m128i sum1 = _mm_load_si128(&reinterpret_cast<const __m128i*>(
-              accumulation[perspectives[p]][0])[j * 2 + 1]);
+              Row(accumulator, perspectives[p], 0))[j * 2 + 1]);
+          for (IndexType i = 1; i < kRefreshTriggers.size(); ++i) {
+            sum0 = _mm_add_epi16(sum0, reinterpret_cast<const __m128i*>(
+                Row(accumulator, perspectives[p], i))[j * 2 + 0]);
+            sum1 = _mm_add_epi16(sum1, reinterpret_cast<const __m128i*>(
+                Row(accumulator, perspectives[p], i))[j * 2 + 1]);
+          }
       const __m128i packedbytes = _mm_packs_epi16(sum0, sum1);
 
           _mm_store_si128(&out[j],
@@ -161,9 +175,15 @@ namespace Eval::NNUE {
         auto out = reinterpret_cast<__m64*>(&output[offset]);
         for (IndexType j = 0; j < kNumChunks; ++j) {
           __m64 sum0 = *(&reinterpret_cast<const __m64*>(
-              accumulation[perspectives[p]][0])[j * 2 + 0]);
+              Row(accumulator, perspectives[p], 0))[j * 2 + 0]);
           __m64 sum1 = *(&reinterpret_cast<const __m64*>(
-              accumulation[perspectives[p]][0])[j * 2 + 1]);
+              Row(accumulator, perspectives[p], 0))[j * 2 + 1]);
+          for (IndexType i = 1; i < kRefreshTriggers.size(); ++i) {
+            sum0 = _mm_add_pi16(sum0, reinterpret_cast<const __m64*>(
+                Row(accumulator, perspectives[p], i))[j * 2 + 0]);
+            sum1 = _mm_add_pi16(sum1, reinterpret_cast<const __m64*>(
+                Row(accumulator, perspectives[p], i))[j * 2 + 1]);
+          }
           const __m64 packedbytes = _mm_packs_pi16(sum0, sum1);
           out[j] = _mm_subs_pi8(_mm_adds_pi8(packedbytes, k0x80s), k0x80s);
         }
@@ -172,13 +192,20 @@ namespace Eval::NNUE {
         const auto out = reinterpret_cast<int8x8_t*>(&output[offset]);
         for (IndexType j = 0; j < kNumChunks; ++j) {
           int16x8_t sum = reinterpret_cast<const int16x8_t*>(
-              accumulation[perspectives[p]][0])[j];
+              Row(accumulator, perspectives[p], 0))[j];
+          for (IndexType i = 1; i < kRefreshTriggers.size(); ++i) {
+            sum = vaddq_s16(sum, reinterpret_cast<const int16x8_t*>(
+                Row(accumulator, perspectives[p], i))[j]);
+          }
           out[j] = vmax_s8(vqmovn_s16(sum), kZero);
         }
 
   #else
         for (IndexType j = 0; j < kHalfDimensions; ++j) {
-          BiasType sum = accumulation[static_cast<int>(perspectives[p])][0][j];
+          BiasType sum = Row(accumulator, perspectives[p], 0)[j];
+          for (IndexType i = 1; i < kRefreshTriggers.size(); ++i) {
+            sum += Row(accumulator, perspectives[p], i)[j];
+          }
           output[offset + j] = static_cast<OutputType>(
               std::max<int>(0, std::min<int>(127, sum)));
         }
@@ -191,64 +218,87 @@ namespace Eval::NNUE {
     }
 
    private:
+    // Row of the accumulator for a perspective and a refresh trigger. The rows
+    // of the architecture are placed one after the other from the start of the
+    // accumulator, so that a smaller net does not touch the rest of it.
+    static constexpr IndexType RowOffset(Color perspective, IndexType i) {
+      return (perspective * kRefreshTriggers.size() + i) * kHalfDimensions;
+    }
+
+    static std::int16_t* Row(Accumulator& accumulator, Color perspective, IndexType i) {
+      return accumulator.accumulation + RowOffset(perspective, i);
+    }
+
+    static const std::int16_t* Row(const Accumulator& accumulator, Color perspective, IndexType i) {
+      return accumulator.accumulation + RowOffset(perspective, i);
+    }
+
+    static_assert(RowOffset(BLACK, kRefreshTriggers.size()) <= CompiledArchitectures::kMaxAccumulationSize, "");
+
     // Calculate cumulative value without using difference calculation
     void RefreshAccumulator(const Position& pos) const {
       auto& accumulator = pos.state()->accumulator;
-      IndexType i = 0;
-      Features::IndexList active_indices[2];
-      RawFeatures::AppendActiveIndices(pos, kRefreshTriggers[i],
-                                       active_indices);
-      for (Color perspective : { WHITE, BLACK }) {
-        std::memcpy(accumulator.accumulation[perspective][i], biases_,
-                   kHalfDimensions * sizeof(BiasType));
-        for (const auto index : active_indices[perspective]) {
-          const IndexType offset = kHalfDimensions * index;
+      for (IndexType i = 0; i < kRefreshTriggers.size(); ++i) {
+        Features::IndexList active_indices[2];
+        RawFeatures::AppendActiveIndices(pos, kRefreshTriggers[i],
+                                         active_indices);
+        for (Color perspective : { WHITE, BLACK }) {
+          if (i == 0) {
+            std::memcpy(Row(accumulator, perspective, i), biases_,
+                       kHalfDimensions * sizeof(BiasType));
+          } else {
+            std::memset(Row(accumulator, perspective, i), 0,
+                       kHalfDimensions * sizeof(BiasType));
+          }
+          for (const auto index : active_indices[perspective]) {
+            const IndexType offset = kHalfDimensions * index;
   #if defined(USE_AVX512)
-          auto accumulation = reinterpret_cast<__m512i*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const __m512i*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / kSimdWidth;
-          for (IndexType j = 0; j < kNumChunks; ++j)
-            _mm512_storeA_si512(&accumulation[j], _mm512_add_epi16(_mm512_loadA_si512(&accumulation[j]), column[j]));
+            auto accumulation = reinterpret_cast<__m512i*>(
+                Row(accumulator, perspective, i));
+            auto column = reinterpret_cast<const __m512i*>(&weights_[offset]);
+            constexpr IndexType kNumChunks = kHalfDimensions / kSimdWidth;
+            for (IndexType j = 0; j < kNumChunks; ++j)
+              _mm512_storeA_si512(&accumulation[j], _mm512_add_epi16(_mm512_loadA_si512(&accumulation[j]), column[j]));
 
   #elif defined(USE_AVX2)
-          auto accumulation = reinterpret_cast<__m256i*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j)
-            _mm256_storeA_si256(&accumulation[j], _mm256_add_epi16(_mm256_loadA_si256(&accumulation[j]), column[j]));
+            auto accumulation = reinterpret_cast<__m256i*>(
+                Row(accumulator, perspective, i));
+            auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
+            constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+            for (IndexType j = 0; j < kNumChunks; ++j)
+              _mm256_storeA_si256(&accumulation[j], _mm256_add_epi16(_mm256_loadA_si256(&accumulation[j]), column[j]));
 
   #elif defined(USE_SSE2)
-          auto accumulation = reinterpret_cast<__m128i*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j)
-            accumulation[j] = _mm_add_epi16(accumulation[j], column[j]);
+            auto accumulation = reinterpret_cast<__m128i*>(
+                Row(accumulator, perspective, i));
+            auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
+            constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+            for (IndexType j = 0; j < kNumChunks; ++j)
+              accumulation[j] = _mm_add_epi16(accumulation[j], column[j]);
 
   #elif defined(USE_MMX)
-          auto accumulation = reinterpret_cast<__m64*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const __m64*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j) {
-            accumulation[j] = _mm_add_pi16(accumulation[j], column[j]);
-          }
+            auto accumulation = reinterpret_cast<__m64*>(
+                Row(accumulator, perspective, i));
+            auto column = reinterpret_cast<const __m64*>(&weights_[offset]);
+            constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+            for (IndexType j = 0; j < kNumChunks; ++j) {
+              accumulation[j] = _mm_add_pi16(accumulation[j], column[j]);
+            }
 
   #elif defined(USE_NEON)
-          auto accumulation = reinterpret_cast<int16x8_t*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j)
-            accumulation[j] = vaddq_s16(accumulation[j], column[j]);
+            auto accumulation = reinterpret_cast<int16x8_t*>(
+                Row(accumulator, perspective, i));
+            auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
+            constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+            for (IndexType j = 0; j < kNumChunks; ++j)
+              accumulation[j] = vaddq_s16(accumulation[j], column[j]);
 
   #else
-          for (IndexType j = 0; j < kHalfDimensions; ++j)
-            accumulator.accumulation[perspective][i][j] += weights_[offset + j];
+            for (IndexType j = 0; j < kHalfDimensions; ++j)
+              Row(accumulator, perspective, i)[j] += weights_[offset + j];
   #endif
 
+          }
         }
       }
   #if defined(USE_MMX)
@@ -261,115 +311,121 @@ namespace Eval::NNUE {
 
     // Calculate cumulative value using difference calculation
     void UpdateAccumulator(const Position& pos) const {
-      const auto prev_accumulator = pos.state()->previous->accumulator;
+      const auto& prev_accumulator = pos.state()->previous->accumulator;
       auto& accumulator = pos.state()->accumulator;
-      IndexType i = 0;
-      Features::IndexList removed_indices[2], added_indices[2];
-      bool reset[2];
-      RawFeatures::AppendChangedIndices(pos, kRefreshTriggers[i],
-                                        removed_indices, added_indices, reset);
-      for (Color perspective : { WHITE, BLACK }) {
+      for (IndexType i = 0; i < kRefreshTriggers.size(); ++i) {
+        Features::IndexList removed_indices[2], added_indices[2];
+        bool reset[2];
+        RawFeatures::AppendChangedIndices(pos, kRefreshTriggers[i],
+                                          removed_indices, added_indices, reset);
+        for (Color perspective : { WHITE, BLACK }) {
 
   #if defined(USE_AVX2)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<__m256i*>(
-            &accumulator.accumulation[perspective][i][0]);
+          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+          auto accumulation = reinterpret_cast<__m256i*>(
+              Row(accumulator, perspective, i));
 
   #elif defined(USE_SSE2)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<__m128i*>(
-            &accumulator.accumulation[perspective][i][0]);
+          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+          auto accumulation = reinterpret_cast<__m128i*>(
+              Row(accumulator, perspective, i));
 
   #elif defined(USE_MMX)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<__m64*>(
-            &accumulator.accumulation[perspective][i][0]);
+          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+          auto accumulation = reinterpret_cast<__m64*>(
+              Row(accumulator, perspective, i));
 
   #elif defined(USE_NEON)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<int16x8_t*>(
-            &accumulator.accumulation[perspective][i][0]);
+          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+          auto accumulation = reinterpret_cast<int16x8_t*>(
+              Row(accumulator, perspective, i));
   #endif
 
-        if (reset[perspective]) {
-          std::memcpy(accumulator.accumulation[perspective][i], biases_,
-                      kHalfDimensions * sizeof(BiasType));
-        } else {
-          std::memcpy(accumulator.accumulation[perspective][i],
-                      prev_accumulator.accumulation[perspective][i],
-                      kHalfDimensions * sizeof(BiasType));
-          // Difference calculation for the deactivated features
-          for (const auto index : removed_indices[perspective]) {
-            const IndexType offset = kHalfDimensions * index;
+          if (reset[perspective]) {
+            if (i == 0) {
+              std::memcpy(Row(accumulator, perspective, i), biases_,
+                          kHalfDimensions * sizeof(BiasType));
+            } else {
+              std::memset(Row(accumulator, perspective, i), 0,
+                          kHalfDimensions * sizeof(BiasType));
+            }
+          } else {
+            std::memcpy(Row(accumulator, perspective, i),
+                        Row(prev_accumulator, perspective, i),
+                        kHalfDimensions * sizeof(BiasType));
+            // Difference calculation for the deactivated features
+            for (const auto index : removed_indices[perspective]) {
+              const IndexType offset = kHalfDimensions * index;
 
   #if defined(USE_AVX2)
-            auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm256_sub_epi16(accumulation[j], column[j]);
-            }
+              auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
+              for (IndexType j = 0; j < kNumChunks; ++j) {
+                accumulation[j] = _mm256_sub_epi16(accumulation[j], column[j]);
+              }
 
   #elif defined(USE_SSE2)
-            auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm_sub_epi16(accumulation[j], column[j]);
-            }
+              auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
+              for (IndexType j = 0; j < kNumChunks; ++j) {
+                accumulation[j] = _mm_sub_epi16(accumulation[j], column[j]);
+              }
 
   #elif defined(USE_MMX)
-            auto column = reinterpret_cast<const __m64*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm_sub_pi16(accumulation[j], column[j]);
-            }
+              auto column = reinterpret_cast<const __m64*>(&weights_[offset]);
+              for (IndexType j = 0; j < kNumChunks; ++j) {
+                accumulation[j] = _mm_sub_pi16(accumulation[j], column[j]);
+              }
 
   #elif defined(USE_NEON)
-            auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = vsubq_s16(accumulation[j], column[j]);
-            }
+              auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
+              for (IndexType j = 0; j < kNumChunks; ++j) {
+                accumulation[j] = vsubq_s16(accumulation[j], column[j]);
+              }
 
   #else
-            for (IndexType j = 0; j < kHalfDimensions; ++j) {
-              accumulator.accumulation[perspective][i][j] -=
-                  weights_[offset + j];
-            }
+              for (IndexType j = 0; j < kHalfDimensions; ++j) {
+                Row(accumulator, perspective, i)[j] -=
+                    weights_[offset + j];
+              }
   #endif
 
+            }
           }
-        }
-        { // Difference calculation for the activated features
-          for (const auto index : added_indices[perspective]) {
-            const IndexType offset = kHalfDimensions * index;
+          { // Difference calculation for the activated features
+            for (const auto index : added_indices[perspective]) {
+              const IndexType offset = kHalfDimensions * index;
 
   #if defined(USE_AVX2)
-            auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm256_add_epi16(accumulation[j], column[j]);
-            }
+              auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
+              for (IndexType j = 0; j < kNumChunks; ++j) {
+                accumulation[j] = _mm256_add_epi16(accumulation[j], column[j]);
+              }
 
   #elif defined(USE_SSE2)
-            auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm_add_epi16(accumulation[j], column[j]);
-            }
+              auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
+              for (IndexType j = 0; j < kNumChunks; ++j) {
+                accumulation[j] = _mm_add_epi16(accumulation[j], column[j]);
+              }
 
   #elif defined(USE_MMX)
-            auto column = reinterpret_cast<const __m64*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm_add_pi16(accumulation[j], column[j]);
-            }
+              auto column = reinterpret_cast<const __m64*>(&weights_[offset]);
+              for (IndexType j = 0; j < kNumChunks; ++j) {
+                accumulation[j] = _mm_add_pi16(accumulation[j], column[j]);
+              }
 
   #elif defined(USE_NEON)
-            auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = vaddq_s16(accumulation[j], column[j]);
-            }
+              auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
+              for (IndexType j = 0; j < kNumChunks; ++j) {
+                accumulation[j] = vaddq_s16(accumulation[j], column[j]);
+              }
 
   #else
-            for (IndexType j = 0; j < kHalfDimensions; ++j) {
-              accumulator.accumulation[perspective][i][j] +=
-                  weights_[offset + j];
-            }
+              for (IndexType j = 0; j < kHalfDimensions; ++j) {
+                Row(accumulator, perspective, i)[j] +=
+                    weights_[offset + j];
+              }
   #endif
 
+            }
           }
         }
       }
@@ -385,13 +441,16 @@ namespace Eval::NNUE {
     using WeightType = std::int16_t;
 
     // Make the learning class a friend
-    friend class Trainer<FeatureTransformer>;
+    friend class Trainer<BasicFeatureTransformer>;
 
     alignas(kCacheLineSize) BiasType biases_[kHalfDimensions];
     alignas(kCacheLineSize)
         WeightType weights_[kHalfDimensions * kInputDimensions];
   };
 
+  // Feature transformer of the default architecture
+  using FeatureTransformer = BasicFeatureTransformer<DefaultArchitecture>;
+
 }  // namespace Eval::NNUE
 
 #endif // #ifndef NNUE_FEATURE_TRANSFORMER_H_INCLUDED
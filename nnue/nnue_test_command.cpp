@@ -1,8 +1,11 @@
 ﻿// USI extended command for NNUE evaluation function
 
+#include "../evaluate.h"
+#include "../misc.h"
 #include "../thread.h"
 #include "../uci.h"
 #include "evaluate_nnue.h"
+#include "evaluate_nnue_learner.h"
 #include "nnue_test_command.h"
 
 #include <set>
@@ -159,12 +162,19 @@ void PrintInfo(std::istream& stream) {
 
     std::cout << file_name << ": ";
     if (success) {
+      const std::string compiled = GetArchitectureString(hash_value);
       if (hash_value == kHashValue) {
         std::cout << "matches with this binary";
         if (architecture != GetArchitectureString()) {
           std::cout << ", but architecture string differs: " << architecture;
         }
         std::cout << std::endl;
+      } else if (!compiled.empty()) {
+        std::cout << "supported by this binary: " << compiled;
+        if (architecture != compiled) {
+          std::cout << ", but architecture string differs: " << architecture;
+        }
+        std::cout << std::endl;
       } else {
         std::cout << architecture << std::endl;
       }
@@ -174,6 +184,57 @@ void PrintInfo(std::istream& stream) {
   }
 }
 
+// Convert a net to the memory mapped format
+void ConvertMapped(std::istream& stream) {
+  std::string input_file, output_file;
+  stream >> input_file >> output_file;
+  if (input_file.empty() || output_file.empty()) {
+    std::cout << "usage: test nnue convert_mapped <input> <output>" << std::endl;
+    return;
+  }
+
+  if (!load_eval_file(input_file)) {
+    std::cout << "Error! " << input_file << " could not be loaded." << std::endl;
+  } else {
+    std::ofstream output_stream(output_file, std::ios::binary);
+    if (WriteMappedParameters(output_stream) && output_stream.flush()) {
+      std::cout << "converted " << input_file << " to " << output_file << std::endl;
+    } else {
+      std::cout << "Error! " << output_file << " could not be written." << std::endl;
+    }
+  }
+
+  // Load the net set in EvalFile again at the next isready
+  eval_file_loaded = "None";
+}
+
+// Measure how long it takes to load a net
+void MeasureLoadTime(std::istream& stream) {
+  std::string file_name;
+  int repeat = 10;
+  stream >> file_name >> repeat;
+  if (file_name.empty() || repeat <= 0) {
+    std::cout << "usage: test nnue load_time <file> [repeat]" << std::endl;
+    return;
+  }
+
+  bool success = true;
+  const TimePoint start = now();
+  for (int i = 0; i < repeat && success; ++i) {
+    success = load_eval_file(file_name);
+  }
+  const TimePoint elapsed = now() - start;
+
+  if (success) {
+    std::cout << file_name << ": " << repeat << " loads, "
+              << (1.0 * elapsed / repeat) << " ms per load" << std::endl;
+  } else {
+    std::cout << "Error! " << file_name << " could not be loaded." << std::endl;
+  }
+
+  eval_file_loaded = "None";
+}
+
 }  // namespace
 
 // USI extended command for NNUE evaluation function
@@ -185,10 +246,23 @@ void TestCommand(Position& pos, std::istream& stream) {
     TestFeatures(pos);
   } else if (sub_command == "info") {
     PrintInfo(stream);
+  } else if (sub_command == "convert_mapped") {
+    ConvertMapped(stream);
+  } else if (sub_command == "load_time") {
+    MeasureLoadTime(stream);
+#if defined(EVAL_LEARN)
+  } else if (sub_command == "training_features") {
+    TestTrainingFeatures(stream);
+#endif
   } else {
     std::cout << "usage:" << std::endl;
     std::cout << " test nnue test_features" << std::endl;
     std::cout << " test nnue info [path/to/" << fileName << "...]" << std::endl;
+    std::cout << " test nnue convert_mapped <input> <output>" << std::endl;
+    std::cout << " test nnue load_time <file> [repeat]" << std::endl;
+#if defined(EVAL_LEARN)
+    std::cout << " test nnue training_features <file.bin>" << std::endl;
+#endif
   }
 }
 
@@ -0,0 +1,109 @@
+﻿// Expansion table of the feature conversion class template of NNUE evaluation function
+
+#ifndef _NNUE_TRAINER_FEATURES_FACTORIZER_TABLE_H_
+#define _NNUE_TRAINER_FEATURES_FACTORIZER_TABLE_H_
+
+#include "factorizer.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Eval {
+
+namespace NNUE {
+
+namespace Features {
+
+// Learning features of every input feature index, built once from
+// Factorizer<FeatureType>::AppendTrainingFeatures(), so that the expansion
+// of an index is the copy of a fixed-size row
+template <typename FeatureType>
+class FactorizerTable {
+ public:
+  // Number of learning feature indices that fit in a row
+  static constexpr IndexType kMaxRowSize = 8;
+
+  // The table, built on first use
+  static const FactorizerTable& Get() {
+    static const FactorizerTable table;
+    return table;
+  }
+
+  // Learning feature indices of an input feature index
+  const IndexType* Row(IndexType base_index) const {
+    return &indices_[base_index * kMaxRowSize];
+  }
+  IndexType RowSize(IndexType base_index) const {
+    return sizes_[base_index];
+  }
+
+  // Append the learning feature indices of an input feature index. Always
+  // writes kMaxRowSize indices, of which the returned number are valid.
+  IndexType Append(IndexType base_index, IndexType* out) const {
+    std::copy_n(Row(base_index), kMaxRowSize, out);
+    return RowSize(base_index);
+  }
+
+  // Sort learning feature indices with an LSD radix sort on bytes, which
+  // beats std::sort on the ~100 indices of an example. buffer must have
+  // room for n indices.
+  static void Sort(IndexType* indices, std::size_t n, IndexType* buffer) {
+    IndexType* src = indices;
+    IndexType* dst = buffer;
+    for (int shift = 0; shift < kIndexBits; shift += 8) {
+      std::size_t offsets[256] = {};
+      for (std::size_t i = 0; i < n; ++i) {
+        ++offsets[(src[i] >> shift) & 0xFF];
+      }
+      for (std::size_t d = 0, sum = 0; d < 256; ++d) {
+        const std::size_t count = offsets[d];
+        offsets[d] = sum;
+        sum += count;
+      }
+      for (std::size_t i = 0; i < n; ++i) {
+        dst[offsets[(src[i] >> shift) & 0xFF]++] = src[i];
+      }
+      std::swap(src, dst);
+    }
+    if (src != indices) {
+      std::copy_n(src, n, indices);
+    }
+  }
+
+ private:
+  FactorizerTable() :
+      indices_(std::size_t(FeatureType::kDimensions) * kMaxRowSize),
+      sizes_(FeatureType::kDimensions) {
+    std::vector<TrainingFeature> training_features;
+    for (IndexType i = 0; i < FeatureType::kDimensions; ++i) {
+      training_features.clear();
+      Factorizer<FeatureType>::AppendTrainingFeatures(i, &training_features);
+      assert(training_features.size() <= kMaxRowSize);
+      for (std::size_t j = 0; j < training_features.size(); ++j) {
+        assert(training_features[j].GetCount() == 1);
+        indices_[i * kMaxRowSize + j] = training_features[j].GetIndex();
+      }
+      sizes_[i] = static_cast<std::uint8_t>(training_features.size());
+    }
+  }
+
+  // Number of bits of the largest learning feature index
+  static constexpr int kIndexBits = [] {
+    int bits = 0;
+    while ((IndexType(1) << bits) < Factorizer<FeatureType>::GetDimensions()) {
+      ++bits;
+    }
+    return bits;
+  }();
+
+  std::vector<IndexType> indices_;
+  std::vector<std::uint8_t> sizes_;
+};
+
+}  // namespace Features
+
+}  // namespace NNUE
+
+}  // namespace Eval
+
+#endif
@@ -9,6 +9,7 @@
 #include "../nnue_feature_transformer.h"
 #include "trainer.h"
 #include "features/factorizer_feature_set.h"
+#include "features/factorizer_table.h"
 
 #include <array>
 #include <bitset>
@@ -251,16 +252,15 @@ class Trainer<FeatureTransformer> {
       target_layer_->biases_[i] =
           Round<typename LayerType::BiasType>(biases_[i] * kBiasScale);
     }
-    std::vector<TrainingFeature> training_features;
-#pragma omp parallel for private(training_features)
+    const auto& table = Features::FactorizerTable<RawFeatures>::Get();
+#pragma omp parallel for
     for (IndexType j = 0; j < RawFeatures::kDimensions; ++j) {
-      training_features.clear();
-      Features::Factorizer<RawFeatures>::AppendTrainingFeatures(
-          j, &training_features);
+      const IndexType* training_features = table.Row(j);
+      const IndexType num_features = table.RowSize(j);
       for (IndexType i = 0; i < kHalfDimensions; ++i) {
         double sum = 0.0;
-        for (const auto& feature : training_features) {
-          sum += weights_[kHalfDimensions * feature.GetIndex() + i];
+        for (IndexType k = 0; k < num_features; ++k) {
+          sum += weights_[kHalfDimensions * training_features[k] + i];
         }
         target_layer_->weights_[kHalfDimensions * j + i] =
             Round<typename LayerType::WeightType>(sum * kWeightScale);
@@ -0,0 +1,283 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2020 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "misc.h"
+#include "movegen.h"
+#include "position.h"
+#include "thread.h"
+#include "uci.h"
+
+using namespace std;
+
+namespace {
+
+  // PerftTable stores the leaf counts of subtrees, keyed by the Zobrist key
+  // and the depth. The key is stored xored with the count, so that an entry
+  // torn by two threads writing it at once reads as a miss.
+  class PerftTable {
+
+    struct Entry {
+      std::atomic<uint64_t> check;
+      std::atomic<uint64_t> nodes;
+    };
+
+  public:
+    explicit PerftTable(size_t mbSize) {
+
+      size_t count = std::min(mbSize, size_t(1) << 20) * 1024 * 1024 / sizeof(Entry);
+      if (!count)
+          return;
+
+      while (count & (count - 1))
+          count &= count - 1;
+
+      table = std::make_unique<Entry[]>(count);
+      mask = count - 1;
+    }
+
+    bool probe(Key key, uint64_t& nodes) const {
+
+      if (!table)
+          return false;
+
+      const Entry& e = table[key & mask];
+      nodes = e.nodes.load(std::memory_order_relaxed);
+      return (e.check.load(std::memory_order_relaxed) ^ nodes) == key;
+    }
+
+    void store(Key key, uint64_t nodes) {
+
+      if (!table)
+          return;
+
+      Entry& e = table[key & mask];
+      e.check.store(key ^ nodes, std::memory_order_relaxed);
+      e.nodes.store(nodes, std::memory_order_relaxed);
+    }
+
+  private:
+    std::unique_ptr<Entry[]> table;
+    size_t mask = 0;
+  };
+
+  // Table key of a position at a given depth
+  Key perft_key(const Position& pos, Depth depth) {
+    return pos.key() ^ (uint64_t(depth) * 0x9E3779B97F4A7C15ULL);
+  }
+
+  // perft() counts the leaf nodes up to the given depth. The last ply is bulk
+  // counted from the size of the legal move list, and the subtrees are cached
+  // in the table.
+  uint64_t perft(Position& pos, Depth depth, PerftTable& table) {
+
+    if (depth <= 1)
+        return depth == 1 ? MoveList<LEGAL>(pos).size() : 1;
+
+    const Key key = perft_key(pos, depth);
+    uint64_t nodes = 0;
+
+    if (table.probe(key, nodes))
+        return nodes;
+
+    StateInfo st;
+    nodes = 0;
+
+    for (const auto& m : MoveList<LEGAL>(pos))
+    {
+        pos.do_move(m, st);
+        nodes += perft(pos, depth - 1, table);
+        pos.undo_move(m);
+    }
+
+    table.store(key, nodes);
+    return nodes;
+  }
+
+  // parallel_perft() splits the root moves of a position across the threads.
+  // Each thread works on its own copy of the position and takes the next root
+  // move when it is done with one. Returns the count of each root move.
+  vector<pair<Move, uint64_t>> parallel_perft(const string& fen, bool chess960,
+                                              Depth depth, PerftTable& table) {
+
+    StateInfo rootState;
+    Position root;
+    root.set(fen, chess960, &rootState, Threads.main());
+
+    vector<pair<Move, uint64_t>> divide;
+    for (const auto& m : MoveList<LEGAL>(root))
+        divide.emplace_back(m, 1);
+
+    if (depth <= 1)
+        return divide;
+
+    std::atomic<size_t> next(0);
+
+    Threads.tasks.parallel_for(Threads.size(), [&](size_t idx) {
+
+        StateInfo rootSt, st;
+        Position pos;
+        pos.set(fen, chess960, &rootSt, Threads[idx]);
+
+        for (size_t i; (i = next.fetch_add(1)) < divide.size(); )
+        {
+            pos.do_move(divide[i].first, st);
+            divide[i].second = perft(pos, depth - 1, table);
+            pos.undo_move(divide[i].first);
+        }
+    });
+
+    return divide;
+  }
+
+  // perft_suite() runs the positions of an EPD file in the format of the usual
+  // perft suites, "<fen> ;D1 20 ;D2 400 ...", up to the given depth, and checks
+  // the counts. A line without counts is run at the given depth.
+  void perft_suite(const string& fileName, Depth maxDepth, PerftTable& table) {
+
+    ifstream file(fileName);
+    if (!file.is_open())
+    {
+        sync_cout << "Unable to open file " << fileName << sync_endl;
+        return;
+    }
+
+    const bool chess960 = Options["UCI_Chess960"];
+    uint64_t nodes = 0, positions = 0, failures = 0;
+    TimePoint elapsed = now();
+    string line;
+
+    while (getline(file, line))
+    {
+        istringstream ss(line);
+        string fen, token;
+        getline(ss, fen, ';');
+
+        if (fen.find_first_not_of(" \t\r") == string::npos)
+            continue;
+
+        vector<pair<Depth, uint64_t>> expected;
+        while (getline(ss, token, ';'))
+        {
+            istringstream ts(token);
+            string d;
+            uint64_t count;
+            if ((ts >> d >> count) && d.size() > 1 && (d[0] == 'D' || d[0] == 'd'))
+            {
+                const Depth depth = Depth(stoi(d.substr(1)));
+                if (depth <= maxDepth)
+                    expected.emplace_back(depth, count);
+            }
+        }
+
+        if (expected.empty() && line.find(';') == string::npos)
+            expected.emplace_back(maxDepth, 0);
+
+        ++positions;
+
+        for (const auto& [depth, count] : expected)
+        {
+            uint64_t cnt = 0;
+            for (const auto& rm : parallel_perft(fen, chess960, depth, table))
+                cnt += rm.second;
+
+            nodes += cnt;
+
+            const bool ok = !count || cnt == count;
+            failures += !ok;
+
+            sync_cout << positions << " D" << depth << " " << cnt
+                      << (!count ? "" : ok ? " ok" : " FAILED, expected " + to_string(count))
+                      << (ok ? "" : "  " + fen) << sync_endl;
+        }
+    }
+
+    elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+    sync_cout << "\n==========================="
+              << "\nPositions       : " << positions
+              << "\nFailures        : " << failures
+              << "\nTotal time (ms) : " << elapsed
+              << "\nNodes searched  : " << nodes
+              << "\nNodes/second    : " << 1000 * nodes / elapsed << sync_endl;
+  }
+
+} // namespace
+
+
+/// run_perft() is called when the engine receives the "perft" command:
+///
+///   perft <depth> [hash <MB>] [file <epd>]
+///
+/// It counts the leaf nodes of the current position, or of every position of
+/// the given file, using all the threads and a dedicated hash table (16 MB by
+/// default, 0 to disable it), and reports the nodes/second. This exercises
+/// move generation and do_move() far deeper than 'go perft'.
+
+void run_perft(Position& pos, istream& is) {
+
+  Depth depth = 0;
+  size_t hashMB = 16;
+  string token, fileName;
+
+  is >> depth;
+
+  while (is >> token)
+      if (token == "hash")
+          is >> hashMB;
+      else if (token == "file")
+          is >> fileName;
+
+  if (depth <= 0)
+  {
+      sync_cout << "usage: perft <depth> [hash <MB>] [file <epd>]" << sync_endl;
+      return;
+  }
+
+  PerftTable table(hashMB);
+
+  if (!fileName.empty())
+  {
+      perft_suite(fileName, depth, table);
+      return;
+  }
+
+  TimePoint elapsed = now();
+  uint64_t nodes = 0;
+
+  for (const auto& [move, cnt] : parallel_perft(pos.fen(), pos.is_chess960(), depth, table))
+  {
+      sync_cout << UCI::move(move, pos.is_chess960()) << ": " << cnt << sync_endl;
+      nodes += cnt;
+  }
+
+  elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+  sync_cout << "\n==========================="
+            << "\nTotal time (ms) : " << elapsed
+            << "\nNodes searched  : " << nodes
+            << "\nNodes/second    : " << 1000 * nodes / elapsed << sync_endl;
+}
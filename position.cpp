@@ -690,6 +690,9 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
 
   assert(is_ok(m));
   assert(&newSt != st);
+#if defined(EVAL_LEARN)
+  assert(!deferredState);
+#endif
 
   thisThread->nodes.fetch_add(1, std::memory_order_relaxed);
   Key k = st->key ^ Zobrist::side;
@@ -1002,13 +1005,18 @@ void Position::do_null_move(StateInfo& newSt) {
   assert(!checkers());
   assert(&newSt != st);
 
+  std::memcpy(&newSt, st, offsetof(StateInfo, accumulator));
+
+  // The accumulator is not copied. It is updated from the previous one when
+  // needed, like after a move that changed no piece, which copies only the
+  // part used by the loaded net and also handles nets with an en passant feature.
   if (Eval::useNNUE != Eval::UseNNUEMode::False)
   {
-      std::memcpy(&newSt, st, sizeof(StateInfo));
-      st->accumulator.computed_score = false;
+      newSt.accumulator.computed_accumulation = false;
+      newSt.accumulator.computed_score = false;
+      newSt.dirtyPiece.dirty_num = 0;
+      newSt.dirtyPiece.piece[0] = NO_PIECE;
   }
-  else
-      std::memcpy(&newSt, st, offsetof(StateInfo, accumulator));
 
   newSt.previous = st;
   st = &newSt;
@@ -1362,6 +1370,22 @@ int Position::set_from_packed_sfen(const Learner::PackedSfen& sfen , StateInfo*
   return Learner::set_from_packed_sfen(*this, sfen, si, th, mirror);
 }
 
+int Position::set_training_position(const Learner::PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror)
+{
+  return Learner::set_training_position(*this, sfen, si, th, mirror);
+}
+
+void Position::complete_state()
+{
+  if (!deferredState)
+      return;
+
+  set_state(st);
+  deferredState = false;
+
+  assert(pos_is_ok());
+}
+
 // Give the board, hand piece, and turn, and return the sfen.
 //std::string Position::sfen_from_rawdata(Piece board[81], Hand hands[2], Color turn, int gamePly_)
 //{
@@ -180,7 +180,8 @@ public:
 #if defined(EVAL_LEARN)
   // --sfenization helper
 
-  friend int Learner::set_from_packed_sfen(Position& pos, const Learner::PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror);
+  template<typename Stream>
+  friend int Learner::unpack(Position& pos, const Learner::PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror, bool lightweight);
 
   // Get the packed sfen. Returns to the buffer specified in the argument.
   // Do not include gamePly in pack.
@@ -192,6 +193,18 @@ public:
   // PackedSfen does not include gamePly so it cannot be restored. If you want to set it, specify it with an argument.
   int set_from_packed_sfen(const Learner::PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror = false);
 
+  // Lightweight version of set_from_packed_sfen() for training samples. Only
+  // the pieces, side to move, castling, en passant and rule50 are set, which
+  // is what NNUE feature extraction and evaluation need. The keys, material,
+  // checkers, pins and check squares are deferred until complete_state().
+  int set_training_position(const Learner::PackedSfen& sfen, StateInfo* si, Thread* th, bool mirror = false);
+
+  // Compute the state deferred by set_training_position(). Must be called
+  // before generating moves, searching or probing with the position, which
+  // is asserted by do_move(), key(), checkers() and MoveList.
+  void complete_state();
+  bool state_deferred() const { return deferredState; }
+
   void clear() { std::memset(this, 0, sizeof(Position)); }
 
   // Give the board, hand piece, and turn, and return the sfen.
@@ -230,6 +243,9 @@ private:
   Thread* thisThread;
   StateInfo* st;
   bool chess960;
+#if defined(EVAL_LEARN)
+  bool deferredState;
+#endif
 };
 
 namespace PSQT {
@@ -325,6 +341,9 @@ inline Bitboard Position::attackers_to(Square s) const {
 }
 
 inline Bitboard Position::checkers() const {
+#if defined(EVAL_LEARN)
+  assert(!deferredState);
+#endif
   return st->checkersBB;
 }
 
@@ -358,6 +377,9 @@ inline int Position::pawns_on_same_color_squares(Color c, Square s) const {
 }
 
 inline Key Position::key() const {
+#if defined(EVAL_LEARN)
+  assert(!deferredState);
+#endif
   return st->key;
 }
 
@@ -148,6 +148,29 @@ namespace {
     bool otherThread, owning;
   };
 
+  // When DeferMoves is set (ABDADA), the moves leading to a node that another
+  // thread is searching are postponed until all the other moves have been
+  // searched, so that the threads split the work instead of duplicating it.
+  bool DeferMoves;
+  constexpr Depth DeferDepth = 4;
+  constexpr int MaxDeferredMoves = 8;
+
+  bool searched_by_other(Thread* thisThread, Key key) {
+    const Breadcrumb& b = breadcrumbs[key & (breadcrumbs.size() - 1)];
+    Thread* tmp = b.thread.load(std::memory_order_relaxed);
+    return tmp && tmp != thisThread && b.key.load(std::memory_order_relaxed) == key;
+  }
+
+  // The search is aborted on a stop of all the threads or, for a search of
+  // the learner, when its own thread has used up the node budget.
+  bool aborted([[maybe_unused]] const Thread* thisThread) {
+    return Threads.stop.load(std::memory_order_relaxed)
+#if defined(EVAL_LEARN)
+        || (thisThread->learnerLimits && thisThread->learnerStop)
+#endif
+        ;
+  }
+
   template <NodeType NT>
   Value search(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth, bool cutNode);
 
@@ -228,6 +251,7 @@ void MainThread::search() {
   Color us = rootPos.side_to_move();
   Time.init(Limits, us, rootPos.game_ply());
   TT.new_search();
+  DeferMoves = Options["Deferred Move Search"] && Threads.size() > 1;
 
   Eval::verify_NNUE();
 
@@ -279,6 +303,16 @@ void MainThread::search() {
   if (bestThread != this)
       sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
 
+#if defined(USE_STATS)
+  sync_cout << Threads.stats() << sync_endl;
+#endif
+
+  // Hits and misses of the tablebase probe cache, as a non-standard token on
+  // the tbhits line would upset the GUIs
+  uint64_t cacheHits = Threads.tb_cache_hits(), cacheMisses = Threads.tb_cache_misses();
+  if (cacheHits + cacheMisses)
+      sync_cout << "info string tbcache hits " << cacheHits << " misses " << cacheMisses << sync_endl;
+
   sync_cout << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
 
   if (bestThread->rootMoves[0].pv.size() > 1 || bestThread->rootMoves[0].extract_ponder_from_tt(rootPos))
@@ -308,6 +342,11 @@ void Thread::search() {
   Color us = rootPos.side_to_move();
   int iterIdx = 0;
 
+#if defined(USE_STATS)
+  SearchStats::Timer statsTimer(stats.searchTicks);
+  const TimePoint searchStart = now();
+#endif
+
   std::memset(ss-7, 0, 10 * sizeof(Stack));
   for (int i = 7; i > 0; i--)
       (ss-i)->continuationHistory = &this->continuationHistory[0][0][NO_PIECE][0]; // Use as a sentinel
@@ -551,6 +590,10 @@ void Thread::search() {
       iterIdx = (iterIdx + 1) & 3;
   }
 
+#if defined(USE_STATS)
+  stats.searchTime += now() - searchStart;
+#endif
+
   if (!mainThread)
       return;
 
@@ -596,7 +639,7 @@ namespace {
 
     Move pv[MAX_PLY+1], capturesSearched[32], quietsSearched[64];
     StateInfo st;
-    TTEntry* tte;
+    TTEntry* tte, ttData;
     Key posKey;
     Move ttMove, move, excludedMove, bestMove;
     Depth extension, newDepth;
@@ -616,7 +659,16 @@ namespace {
     bestValue = -VALUE_INFINITE;
     maxValue = VALUE_INFINITE;
 
-    // Check for the available remaining time
+    // Check for the available remaining time. The searches of the learner
+    // only have a node budget, which every thread checks for itself once the
+    // first iteration is complete.
+#if defined(EVAL_LEARN)
+    if (const Learner::SearchLimits* limits = thisThread->learnerLimits)
+        thisThread->learnerStop |=   limits->nodes
+                                  && thisThread->completedDepth > 0
+                                  && thisThread->nodes.load(std::memory_order_relaxed) >= limits->nodes * limits->multiPV;
+    else
+#endif
     if (thisThread == Threads.main())
         static_cast<MainThread*>(thisThread)->check_time();
 
@@ -627,7 +679,7 @@ namespace {
     if (!rootNode)
     {
         // Step 2. Check for aborted search and immediate draw
-        if (   Threads.stop.load(std::memory_order_relaxed)
+        if (   aborted(thisThread)
             || pos.is_draw(ss->ply)
             || ss->ply >= MAX_PLY)
             return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos)
@@ -667,11 +719,14 @@ namespace {
     // position key in case of an excluded move.
     excludedMove = ss->excludedMove;
     posKey = excludedMove == MOVE_NONE ? pos.key() : pos.key() ^ make_key(excludedMove);
-    tte = TT.probe(posKey, ttHit);
-    ttValue = ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
+    tte = TT.probe(posKey, ttHit, ttData);
+#if defined(USE_STATS)
+    thisThread->stats.ttHits += ttHit;
+#endif
+    ttValue = ttHit ? value_from_tt(ttData.value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove =  rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0]
-            : ttHit    ? tte->move() : MOVE_NONE;
-    ttPv = PvNode || (ttHit && tte->is_pv());
+            : ttHit    ? ttData.move() : MOVE_NONE;
+    ttPv = PvNode || (ttHit && ttData.is_pv());
     formerPv = ttPv && !PvNode;
 
     if (   ttPv
@@ -688,10 +743,10 @@ namespace {
     // At non-PV nodes we check for an early TT cutoff
     if (  !PvNode
         && ttHit
-        && tte->depth() >= depth
+        && ttData.depth() >= depth
         && ttValue != VALUE_NONE // Possible in case of TT access race
-        && (ttValue >= beta ? (tte->bound() & BOUND_LOWER)
-                            : (tte->bound() & BOUND_UPPER)))
+        && (ttValue >= beta ? (ttData.bound() & BOUND_LOWER)
+                            : (ttData.bound() & BOUND_UPPER)))
     {
         // If ttMove is quiet, update move sorting heuristics on TT hit
         if (ttMove)
@@ -783,7 +838,7 @@ namespace {
     else if (ttHit)
     {
         // Never assume anything about values stored in TT
-        ss->staticEval = eval = tte->eval();
+        ss->staticEval = eval = ttData.eval();
         if (eval == VALUE_NONE)
             ss->staticEval = eval = evaluate(pos);
 
@@ -792,7 +847,7 @@ namespace {
 
         // Can ttValue be used as a better position evaluation?
         if (    ttValue != VALUE_NONE
-            && (tte->bound() & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER)))
+            && (ttData.bound() & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER)))
             eval = ttValue;
     }
     else
@@ -885,14 +940,14 @@ namespace {
         // because probCut search has depth set to depth - 4 but we also do a move before it
         // so effective depth is equal to depth - 3
         && !(   ttHit
-             && tte->depth() >= depth - 3
+             && ttData.depth() >= depth - 3
              && ttValue != VALUE_NONE
              && ttValue < probCutBeta))
     {
         // if ttMove is a capture and value from transposition table is good enough produce probCut
         // cutoff without digging into actual probCut search
         if (   ttHit
-            && tte->depth() >= depth - 3
+            && ttData.depth() >= depth - 3
             && ttValue != VALUE_NONE
             && ttValue >= probCutBeta
             && ttMove
@@ -934,7 +989,7 @@ namespace {
                 {
                     // if transposition table doesn't have equal or more deep info write probCut data into it
                     if ( !(ttHit
-                       && tte->depth() >= depth - 3
+                       && ttData.depth() >= depth - 3
                        && ttValue != VALUE_NONE))
                         tte->save(posKey, value_to_tt(value, ss->ply), ttPv,
                             BOUND_LOWER,
@@ -967,9 +1022,21 @@ moves_loop: // When in check, search starts from here
     // Mark this node as being searched
     ThreadHolding th(thisThread, posKey, ss->ply);
 
+    // Moves postponed because another thread is searching them, only the
+    // children with breadcrumbs (ply < 8) can be detected. Few moves are busy
+    // at once, when the buffer is full a move is searched right away.
+    Move deferredMoves[MaxDeferredMoves];
+    int deferredCount = 0, deferredIdx = 0;
+    const bool deferring = DeferMoves && !rootNode && ss->ply < 7 && depth >= DeferDepth;
+
+    auto next_move = [&]() {
+        Move m = mp.next_move(moveCountPruning);
+        return m != MOVE_NONE || deferredIdx == deferredCount ? m : deferredMoves[deferredIdx++];
+    };
+
     // Step 11. Loop through all pseudo-legal moves until no moves remain
     // or a beta cutoff occurs.
-    while ((move = mp.next_move(moveCountPruning)) != MOVE_NONE)
+    while ((move = next_move()) != MOVE_NONE)
     {
       assert(is_ok(move));
 
@@ -988,11 +1055,23 @@ moves_loop: // When in check, search starts from here
       if (!rootNode && !pos.legal(move))
           continue;
 
+      // Postpone the move if another thread is busy with it. The first move is
+      // always searched and a postponed move is never postponed again.
+      if (   deferring
+          && moveCount
+          && !deferredIdx
+          && deferredCount < MaxDeferredMoves
+          && searched_by_other(thisThread, pos.key_after(move)))
+      {
+          deferredMoves[deferredCount++] = move;
+          continue;
+      }
+
       ss->moveCount = ++moveCount;
 
       if (rootNode && thisThread == Threads.main() && Time.elapsed() > 3000
 #if defined(EVAL_LEARN)
-          && !Limits.silent
+          && !thisThread->learnerLimits
 #endif
           )
           sync_cout << "info depth " << depth
@@ -1083,8 +1162,8 @@ moves_loop: // When in check, search starts from here
           && !excludedMove // Avoid recursive singular search
        /* &&  ttValue != VALUE_NONE Already implicit in the next condition */
           &&  abs(ttValue) < VALUE_KNOWN_WIN
-          && (tte->bound() & BOUND_LOWER)
-          &&  tte->depth() >= depth - 3)
+          && (ttData.bound() & BOUND_LOWER)
+          &&  ttData.depth() >= depth - 3)
       {
           Value singularBeta = ttValue - ((formerPv + 4) * depth) / 2;
           Depth singularDepth = (depth - 1 + 3 * formerPv) / 2;
@@ -1296,7 +1375,7 @@ moves_loop: // When in check, search starts from here
       // Finished searching the move. If a stop occurred, the return value of
       // the search cannot be trusted, and we return immediately without
       // updating best move, PV and TT.
-      if (Threads.stop.load(std::memory_order_relaxed))
+      if (aborted(thisThread))
           return VALUE_ZERO;
 
       if (rootNode)
@@ -1346,6 +1425,9 @@ moves_loop: // When in check, search starts from here
               {
                   assert(value >= beta); // Fail high
                   ss->statScore = 0;
+#if defined(USE_STATS)
+                  thisThread->stats.cutoffs[std::min(moveCount, 8) - 1]++;
+#endif
                   break;
               }
           }
@@ -1417,7 +1499,7 @@ moves_loop: // When in check, search starts from here
 
     Move pv[MAX_PLY+1];
     StateInfo st;
-    TTEntry* tte;
+    TTEntry* tte, ttData;
     Key posKey;
     Move ttMove, move, bestMove;
     Depth ttDepth;
@@ -1437,6 +1519,9 @@ moves_loop: // When in check, search starts from here
     bestMove = MOVE_NONE;
     ss->inCheck = pos.checkers();
     moveCount = 0;
+#if defined(USE_STATS)
+    thisThread->stats.qnodes++;
+#endif
 
     // Check for an immediate draw or maximum ply reached
     if (   pos.is_draw(ss->ply)
@@ -1452,17 +1537,20 @@ moves_loop: // When in check, search starts from here
                                                   : DEPTH_QS_NO_CHECKS;
     // Transposition table lookup
     posKey = pos.key();
-    tte = TT.probe(posKey, ttHit);
-    ttValue = ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
-    ttMove = ttHit ? tte->move() : MOVE_NONE;
-    pvHit = ttHit && tte->is_pv();
+    tte = TT.probe(posKey, ttHit, ttData);
+#if defined(USE_STATS)
+    thisThread->stats.ttHits += ttHit;
+#endif
+    ttValue = ttHit ? value_from_tt(ttData.value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
+    ttMove = ttHit ? ttData.move() : MOVE_NONE;
+    pvHit = ttHit && ttData.is_pv();
 
     if (  !PvNode
         && ttHit
-        && tte->depth() >= ttDepth
+        && ttData.depth() >= ttDepth
         && ttValue != VALUE_NONE // Only in case of TT access race
-        && (ttValue >= beta ? (tte->bound() & BOUND_LOWER)
-                            : (tte->bound() & BOUND_UPPER)))
+        && (ttValue >= beta ? (ttData.bound() & BOUND_LOWER)
+                            : (ttData.bound() & BOUND_UPPER)))
         return ttValue;
 
     // Evaluate the position statically
@@ -1476,12 +1564,12 @@ moves_loop: // When in check, search starts from here
         if (ttHit)
         {
             // Never assume anything about values stored in TT
-            if ((ss->staticEval = bestValue = tte->eval()) == VALUE_NONE)
+            if ((ss->staticEval = bestValue = ttData.eval()) == VALUE_NONE)
                 ss->staticEval = bestValue = evaluate(pos);
 
             // Can ttValue be used as a better position evaluation?
             if (    ttValue != VALUE_NONE
-                && (tte->bound() & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER)))
+                && (ttData.bound() & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER)))
                 bestValue = ttValue;
         }
         else
@@ -1609,7 +1697,12 @@ moves_loop: // When in check, search starts from here
               if (PvNode && value < beta) // Update alpha here!
                   alpha = value;
               else
+              {
+#if defined(USE_STATS)
+                  thisThread->stats.cutoffs[std::min(moveCount, 8) - 1]++;
+#endif
                   break; // Fail high
+              }
           }
        }
     }
@@ -1916,11 +2009,12 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
         return false;
 
     pos.do_move(pv[0], st);
-    TTEntry* tte = TT.probe(pos.key(), ttHit);
+    TTEntry ttData;
+    TT.probe(pos.key(), ttHit, ttData);
 
     if (ttHit)
     {
-        Move m = tte->move(); // Local copy to be SMP safe
+        Move m = ttData.move();
         if (MoveList<LEGAL>(pos).contains(m))
             pv.push_back(m);
     }
@@ -1986,8 +2080,25 @@ namespace Learner
   // From now on, it is better to have a Searcher and prepare a substitution table for each thread like Apery.
   // It might have been good.
 
+  // Contempt of the side to move, as set up for the searches of the learner.
+  // They are analysis searches, so the analysis contempt applies.
+  Score learner_contempt(Color us)
+  {
+    int ct = int(Options["Contempt"]) * PawnValueEg / 100; // From centipawns
+    const auto& analysisContempt = Options["Analysis Contempt"];
+
+    ct = analysisContempt == "Off" ? 0
+      : analysisContempt == "Both" ? ct
+      : analysisContempt == "White" && us == BLACK ? -ct
+      : analysisContempt == "Black" && us == WHITE ? -ct
+      : ct;
+
+    // Evaluation score is from the white point of view
+    return us == WHITE ? make_score(ct, ct / 2) : -make_score(ct, ct / 2);
+  }
+
   // Initialization for learning.
-  // Called from Learner::search(),Learner::qsearch().
+  // Called from Learner::search().
   void init_for_search(Position& pos, Stack* ss)
   {
 
@@ -1996,30 +2107,6 @@ namespace Learner
 
     std::memset(ss - 7, 0, 10 * sizeof(Stack));
 
-    // About Search::Limits
-    // Be careful because this member variable is global and affects other threads.
-    {
-      auto& limits = Search::Limits;
-
-      // Make the search equivalent to the "go infinite" command. (Because it is troublesome if time management is done)
-      limits.infinite = true;
-
-      // Since PV is an obstacle when displayed, erase it.
-      limits.silent = true;
-
-      // If you use this, it will be compared with the accumulated nodes of each thread. Therefore, do not use it.
-      limits.nodes = 0;
-
-      // depth is also processed by the one passed as an argument of Learner::search().
-      limits.depth = 0;
-
-      // Set a large value to prevent the draw value from being returned due to the number of moves near the draw.
-      //limits.max_game_ply = 1 << 16;
-
-      // If you do not include the ball entry rule, it will be a draw and it will be difficult to settle.
-      //limits.enteringKingRule = EnteringKingRule::EKR_27_POINT;
-    }
-
     // Set DrawValue
     {
       // Because it is not prepared for each thread
@@ -2046,20 +2133,7 @@ namespace Learner
       // Clear all history types. This initialization takes a little time, and the accuracy of the search is rather low, so the good and bad are not well understood.
       // th->clear();
 
-      int ct = int(Options["Contempt"]) * PawnValueEg / 100; // From centipawns
-      Color us = pos.side_to_move();
-
-      // In analysis mode, adjust contempt in accordance with user preference
-      if (Limits.infinite || Options["UCI_AnalyseMode"])
-        ct = Options["Analysis Contempt"] == "Off" ? 0
-        : Options["Analysis Contempt"] == "Both" ? ct
-        : Options["Analysis Contempt"] == "White" && us == BLACK ? -ct
-        : Options["Analysis Contempt"] == "Black" && us == WHITE ? -ct
-        : ct;
-
-      // Evaluation score is from the white point of view
-      th->contempt = (us == WHITE ? make_score(ct, ct / 2)
-        : -make_score(ct, ct / 2));
+      th->contempt = learner_contempt(pos.side_to_move());
 
       for (int i = 7; i > 0; i--)
           (ss - i)->continuationHistory = &th->continuationHistory[0][0][NO_PIECE][0]; // Use as a sentinel
@@ -2075,49 +2149,95 @@ namespace Learner
     }
   }
 
-  // A pair of reader and evaluation value. Returned by Learner::search(),Learner::qsearch().
-  typedef std::pair<Value, std::vector<Move> > ValueAndPV;
-
-  // Stationary search.
+  // Stationary search of a batch of positions, all set on the same search
+  // thread. The search stack, the contempt and the thread variables are set
+  // up once for the whole batch rather than for every position, and the root
+  // moves are not touched at all since qsearch() does not use them. Only the
+  // first plies of the stack, written by qsearch(), are reset between the
+  // positions. results must have room for count entries.
   //
   // Precondition) Search thread is set by pos.set_this_thread(Threads[thread_id]).
   // Also, when Threads.stop arrives, the search is interrupted, so the PV at that time is not correct.
-  // After returning from search(), if Threads.stop == true, do not use the search result.
-  // Also, note that before calling, if you do not call it with Threads.stop == false, the search will be interrupted and it will return.
-  //
-  // If it is clogged, MOVE_RESIGN is returned in the PV array.
+  // After returning from qsearch(), if Threads.stop == true, do not use the search result.
   //
   //Although it was possible to specify alpha and beta with arguments, this will show the result when searching in that window
   // Because it writes to the substitution table, the value that can be pruned is written to that window when learning
   // As it has a bad effect, I decided to stop allowing the window range to be specified.
-  ValueAndPV qsearch(Position& pos)
+  void qsearch(Position* const* positions, size_t count, ValueAndPV* results)
   {
+    if (count == 0)
+      return;
+
     Stack stack[MAX_PLY + 10], * ss = stack + 7;
     Move pv[MAX_PLY + 1];
 
-    init_for_search(pos, ss);
-    ss->pv = pv; // For the time being, it must be a dummy and somewhere with a buffer.
+    std::memset(ss - 7, 0, 10 * sizeof(Stack));
 
-    if (pos.is_draw(0)) {
-      // Return draw value if draw.
-      return { VALUE_DRAW, {} };
-    }
+    auto th = positions[0]->this_thread();
+    // The contempt reads the options, so it is only computed for the colors
+    // that are actually to move in the batch.
+    Score contempt[COLOR_NB] = { SCORE_ZERO, SCORE_ZERO };
+    bool contemptSet[COLOR_NB] = { false, false };
 
-    // Is it stuck?
-    if (MoveList<LEGAL>(pos).size() == 0)
+    th->completedDepth = 0;
+    th->selDepth = 0;
+    th->rootDepth = 0;
+    th->nmpMinPly = th->bestMoveChanges = 0;
+    th->ttHitAverage = TtHitAverageWindow * TtHitAverageResolution / 2;
+    th->nodes = 0;
+
+    for (int i = 7; i > 0; i--)
+      (ss - i)->continuationHistory = &th->continuationHistory[0][0][NO_PIECE][0]; // Use as a sentinel
+
+    for (size_t i = 0; i < count; ++i)
     {
-      // Return the mated value if checkmated.
-      return { mated_in(/*ss->ply*/ 0 + 1), {} };
-    }
+      Position& pos = *positions[i];
+      ValueAndPV& result = results[i];
 
-    auto bestValue = ::qsearch<PV>(pos, ss, -VALUE_INFINITE, VALUE_INFINITE, 0);
+      assert(pos.this_thread() == th);
 
-  // Returns the PV obtained.
-    std::vector<Move> pvs;
-    for (Move* p = &ss->pv[0]; is_ok(*p); ++p)
-      pvs.push_back(*p);
+      result.second.clear();
 
-    return ValueAndPV(bestValue, pvs);
+      if (pos.is_draw(0)) {
+        // Return draw value if draw.
+        result.first = VALUE_DRAW;
+        continue;
+      }
+
+      // Is it stuck?
+      if (MoveList<LEGAL>(pos).size() == 0)
+      {
+        // Return the mated value if checkmated.
+        result.first = mated_in(/*ss->ply*/ 0 + 1);
+        continue;
+      }
+
+      std::memset(ss, 0, 3 * sizeof(Stack));
+      ss->pv = pv; // For the time being, it must be a dummy and somewhere with a buffer.
+      const Color us = pos.side_to_move();
+      if (!contemptSet[us])
+      {
+        contempt[us] = learner_contempt(us);
+        contemptSet[us] = true;
+      }
+      th->contempt = contempt[us];
+
+      result.first = ::qsearch<PV>(pos, ss, -VALUE_INFINITE, VALUE_INFINITE, 0);
+
+      // Returns the PV obtained.
+      for (Move* p = &ss->pv[0]; is_ok(*p); ++p)
+        result.second.push_back(*p);
+    }
+  }
+
+  // Stationary search of a single position. See the batch version above.
+  ValueAndPV qsearch(Position& pos)
+  {
+    Position* positions[] = { &pos };
+    ValueAndPV result;
+
+    qsearch(positions, 1, &result);
+    return result;
   }
 
   // Normal search. Depth depth (specified as an integer).
@@ -2126,7 +2246,12 @@ namespace Learner
   // Do something like
   // Evaluation value is obtained in v.first and PV is obtained in v.second.
   // When multi pv is enabled, you can get the PV (reading line) array in pos.this_thread()->rootMoves[N].pv.
-  // Specify multi pv with the argument multiPV of this function. (The value of Options["MultiPV"] is ignored)
+  // Specify multi pv with limits.multiPV. (The value of Options["MultiPV"] is ignored)
+  //
+  // The limits are carried by the thread for the time of the search, and the
+  // global Search::Limits is not touched, so the threads can search with
+  // different limits at the same time. A node limit stops the search of this
+  // thread only, once the first iteration is complete.
   //
   // Declaration win judgment is not done as root (because it is troublesome to handle), so it is not done here.
   // Handle it by the caller.
@@ -2136,11 +2261,11 @@ namespace Learner
   // After returning from search(), if Threads.stop == true, do not use the search result.
   // Also, note that before calling, if you do not call it with Threads.stop == false, the search will be interrupted and it will return.
 
-  ValueAndPV search(Position& pos, int depth_, size_t multiPV /* = 1 */, uint64_t nodesLimit /* = 0 */)
+  ValueAndPV search(Position& pos, const SearchLimits& limits)
   {
     std::vector<Move> pvs;
 
-    Depth depth = depth_;
+    Depth depth = limits.depth;
     if (depth < 0)
       return std::pair<Value, std::vector<Move>>(Eval::evaluate(pos), std::vector<Move>());
 
@@ -2167,10 +2292,15 @@ namespace Learner
      //size_t multiPV = Options["MultiPV"];
 
      // Do not exceed the number of moves in this situation
-    multiPV = std::min(multiPV, rootMoves.size());
+    SearchLimits threadLimits = limits;
+    threadLimits.multiPV = std::min(limits.multiPV, rootMoves.size());
+    const size_t multiPV = threadLimits.multiPV;
 
      // If you do not multiply the node limit by the value of MultiPV, you will not be thinking about the same node for one candidate hand when you fix the depth and have MultiPV.
-    nodesLimit *= multiPV;
+    const uint64_t nodesLimit = limits.nodes * multiPV;
+
+    th->learnerLimits = &threadLimits;
+    th->learnerStop = false;
 
     Value alpha = -VALUE_INFINITE;
     Value beta = VALUE_INFINITE;
@@ -2181,6 +2311,7 @@ namespace Learner
 	  // exit this loop even if the node limit is exceeded
       // The number of search nodes is passed in the argument of this function.
       && !(nodesLimit /* limited nodes */ && th->nodes.load(std::memory_order_relaxed) >= nodesLimit)
+      && !th->learnerStop
       )
     {
       for (RootMove& rm : rootMoves)
@@ -2190,7 +2321,7 @@ namespace Learner
       pvLast = 0;
 
       // MultiPV loop. We perform a full root search for each PV line
-      for (pvIdx = 0; pvIdx < multiPV && !Threads.stop; ++pvIdx)
+      for (pvIdx = 0; pvIdx < multiPV && !Threads.stop && !th->learnerStop; ++pvIdx)
       {
         if (pvIdx == pvLast)
         {
@@ -2224,6 +2355,12 @@ namespace Learner
           stable_sort(rootMoves.begin() + pvIdx, rootMoves.end());
           //my_stable_sort(pos.this_thread()->thread_id(),&rootMoves[0] + pvIdx, rootMoves.size() - pvIdx);
 
+          // If the node budget is used up, we break immediately. Sorting is
+          // safe because the root moves are still valid, although they may
+          // refer to the previous iteration.
+          if (th->learnerStop)
+            break;
+
 		  // Expand aspiration window for fail low/high.
           // However, if it is the value specified by the argument, it will be treated as fail low/high and break.
           if (bestValue <= alpha)
@@ -2256,7 +2393,8 @@ namespace Learner
 
       } // multi PV
 
-      completedDepth = rootDepth;
+      if (!th->learnerStop)
+        completedDepth = rootDepth;
     }
 
     // Pass PV_is(ok) to eliminate this PV, there may be NULL_MOVE in the middle.
@@ -2274,8 +2412,21 @@ namespace Learner
     // Considering multiPV, the score of rootMoves[0] is returned as bestValue.
     bestValue = rootMoves[0].score;
 
+    th->learnerLimits = nullptr;
+    th->learnerStop = false;
+
     return ValueAndPV(bestValue, pvs);
   }
 
+  ValueAndPV search(Position& pos, int depth_, size_t multiPV /* = 1 */, uint64_t nodesLimit /* = 0 */)
+  {
+    SearchLimits limits;
+    limits.depth = depth_;
+    limits.multiPV = multiPV;
+    limits.nodes = nodesLimit;
+
+    return search(pos, limits);
+  }
+
 }
 #endif
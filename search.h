@@ -90,9 +90,6 @@ struct LimitsType {
     time[WHITE] = time[BLACK] = inc[WHITE] = inc[BLACK] = npmsec = movetime = TimePoint(0);
     movestogo = depth = mate = perft = infinite = 0;
     nodes = 0;
-#if defined (EVAL_LEARN)
-    silent = false;
-#endif
   }
 
   bool use_time_management() const {
@@ -103,11 +100,6 @@ struct LimitsType {
   TimePoint time[COLOR_NB], inc[COLOR_NB], npmsec, movetime, startTime;
   int movestogo, depth, mate, perft, infinite;
   int64_t nodes;
-#if defined (EVAL_LEARN)
-  // Silent mode that does not output to the screen (for continuous self-play in process)
-  // Do not output PV at this time.
-  bool silent;
-#endif
 };
 
 extern LimitsType Limits;
@@ -123,7 +115,18 @@ namespace Learner {
   // A pair of reader and evaluation value. Returned by Learner::search(),Learner::qsearch().
   using ValueAndPV = std::pair<Value, std::vector<Move>>;
 
+  // Limits of a Learner::search(). They are carried by the search thread
+  // rather than set in the global Search::Limits, so that every thread can
+  // search with its own depth and node budget.
+  struct SearchLimits {
+    int depth = 1;
+    size_t multiPV = 1;
+    uint64_t nodes = 0; // Per PV line, 0 for no limit
+  };
+
   ValueAndPV qsearch(Position& pos);
+  void qsearch(Position* const* positions, size_t count, ValueAndPV* results);
+  ValueAndPV search(Position& pos, const SearchLimits& limits);
   ValueAndPV search(Position& pos, int depth_, size_t multiPV = 1, uint64_t nodesLimit = 0);
 }
 #endif
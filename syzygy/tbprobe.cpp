@@ -32,6 +32,7 @@
 #include "../movegen.h"
 #include "../position.h"
 #include "../search.h"
+#include "../thread.h"
 #include "../types.h"
 #include "../uci.h"
 
@@ -172,6 +173,8 @@ class TBFile : public std::ifstream {
     std::string fname;
 
 public:
+    uint64_t size = 0; // Size of the file, once mapped
+
     // Look for and open the file among the Paths directories where the .rtbw
     // and .rtbz files can be found. Multiple directories are separated by ";"
     // on Windows and by ":" on Unix-based operating systems.
@@ -221,7 +224,7 @@ public:
             exit(EXIT_FAILURE);
         }
 
-        *mapping = statbuf.st_size;
+        *mapping = size = statbuf.st_size;
         *baseAddress = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
         madvise(*baseAddress, statbuf.st_size, MADV_RANDOM);
         ::close(fd);
@@ -248,6 +251,7 @@ public:
             exit(EXIT_FAILURE);
         }
 
+        size = (uint64_t(size_high) << 32) | size_low;
         HANDLE mmap = CreateFileMapping(fd, nullptr, PAGE_READONLY, size_high, size_low, nullptr);
         CloseHandle(fd);
 
@@ -331,9 +335,12 @@ struct TBTable {
     static constexpr int Sides = Type == WDL ? 2 : 1;
 
     std::atomic_bool ready;
+    std::mutex mutex; // Held while the file is mapped
+    std::string name; // File name without extension, like "KRvK"
     void* baseAddress;
     uint8_t* map;
     uint64_t mapping;
+    uint64_t size;
     Key key;
     Key key2;
     int pieceCount;
@@ -346,7 +353,7 @@ struct TBTable {
         return &items[stm % Sides][hasPawns ? f : 0];
     }
 
-    TBTable() : ready(false), baseAddress(nullptr) {}
+    TBTable() : ready(false), baseAddress(nullptr), size(0) {}
     explicit TBTable(const std::string& code);
     explicit TBTable(const TBTable<WDL>& wdl);
 
@@ -362,6 +369,7 @@ TBTable<WDL>::TBTable(const std::string& code) : TBTable() {
     StateInfo st;
     Position pos;
 
+    name = code;
     key = pos.set(code, WHITE, &st).material_key();
     pieceCount = pos.count<ALL_PIECES>();
     hasPawns = pos.pieces(PAWN);
@@ -388,6 +396,7 @@ template<>
 TBTable<DTZ>::TBTable(const TBTable<WDL>& wdl) : TBTable() {
 
     // Use the corresponding WDL table to avoid recalculating all from scratch
+    name = wdl.name;
     key = wdl.key;
     key2 = wdl.key2;
     pieceCount = wdl.pieceCount;
@@ -463,6 +472,14 @@ public:
     }
     size_t size() const { return wdlTable.size(); }
     void add(const std::vector<PieceType>& pieces);
+
+    template<TBType Type>
+    TBTable<Type>& at(size_t idx) {
+        if constexpr (Type == WDL)
+            return wdlTable[idx];
+        else
+            return dtzTable[idx];
+    }
 };
 
 TBTables TBTables;
@@ -1125,39 +1142,34 @@ void set(T& e, uint8_t* data) {
         }
 }
 
-// If the TB file corresponding to the given position is already memory mapped
-// then return its base address, otherwise try to memory map and init it. Called
-// at every probe, memory map and init only at first access. Function is thread
-// safe and can be called concurrently.
+// If the TB file of the given table is already memory mapped then return its
+// base address, otherwise try to memory map and init it. Called at every probe,
+// memory map and init only at first access, or at warm-up. Function is thread
+// safe and can be called concurrently. Each table has its own lock, so that a
+// slow mapping of a file does not hold up the probes of the other tables.
 template<TBType Type>
-void* mapped(TBTable<Type>& e, const Position& pos) {
-
-    static std::mutex mutex;
+void* mapped(TBTable<Type>& e) {
 
     // Use 'acquire' to avoid a thread reading 'ready' == true while
     // another is still working. (compiler reordering may cause this).
     if (e.ready.load(std::memory_order_acquire))
         return e.baseAddress; // Could be nullptr if file does not exist
 
-    std::unique_lock<std::mutex> lk(mutex);
+    std::unique_lock<std::mutex> lk(e.mutex);
 
     if (e.ready.load(std::memory_order_relaxed)) // Recheck under lock
         return e.baseAddress;
 
-    // Pieces strings in decreasing order for each color, like ("KPP","KR")
-    std::string fname, w, b;
-    for (PieceType pt = KING; pt >= PAWN; --pt) {
-        w += std::string(popcount(pos.pieces(WHITE, pt)), PieceToChar[pt]);
-        b += std::string(popcount(pos.pieces(BLACK, pt)), PieceToChar[pt]);
-    }
-
-    fname =  (e.key == pos.material_key() ? w + 'v' + b : b + 'v' + w)
-           + (Type == WDL ? ".rtbw" : ".rtbz");
-
-    uint8_t* data = TBFile(fname).map(&e.baseAddress, &e.mapping, Type);
+    // The name is the one of the white pieces first, like "KRvK", whichever
+    // color has them in the probed position
+    TBFile file(e.name + (Type == WDL ? ".rtbw" : ".rtbz"));
+    uint8_t* data = file.map(&e.baseAddress, &e.mapping, Type);
 
     if (data)
+    {
+        e.size = file.size;
         set(e, data);
+    }
 
     e.ready.store(true, std::memory_order_release);
     return e.baseAddress;
@@ -1171,7 +1183,7 @@ Ret probe_table(const Position& pos, ProbeState* result, WDLScore wdl = WDLDraw)
 
     TBTable<Type>* entry = TBTables.get<Type>(pos.material_key());
 
-    if (!entry || !mapped(*entry, pos))
+    if (!entry || !mapped(*entry))
         return *result = FAIL, Ret();
 
     return do_probe_table(pos, entry, wdl, result);
@@ -1252,6 +1264,76 @@ WDLScore search(Position& pos, ProbeState* result) {
     return *result = OK, value;
 }
 
+// ProbeCache keeps the results of successful WDL and DTZ probes, keyed by the
+// position key, so that positions probed again by another thread or at a later
+// iteration skip the index computation and the decompression of the pairs.
+// The key is stored xored with the result, so that an entry torn by two threads
+// writing it at once reads as a miss. The results do not depend on the 50-move
+// counter, which is not part of the key.
+class ProbeCache {
+
+    struct Entry {
+        std::atomic<uint64_t> check;
+        std::atomic<uint64_t> data;
+    };
+
+    static constexpr size_t Size = 1 << 16; // 1 MB
+
+    template<TBType Type>
+    static Key cache_key(const Position& pos) {
+        return pos.key() ^ (Type == DTZ ? 0x9E3779B97F4A7C15ULL : 0);
+    }
+
+    static void count(const Position& pos, bool hit) {
+        if (Thread* th = pos.this_thread())
+            (hit ? th->tbCacheHits : th->tbCacheMisses).fetch_add(1, std::memory_order_relaxed);
+    }
+
+public:
+    template<TBType Type>
+    bool probe(const Position& pos, ProbeState* result, int& value) const {
+
+        const Key key = cache_key<Type>(pos);
+        const Entry& e = table[key & (Size - 1)];
+        const uint64_t data = e.data.load(std::memory_order_relaxed);
+        const bool hit = (e.check.load(std::memory_order_relaxed) ^ data) == key;
+
+        count(pos, hit);
+
+        if (!hit)
+            return false;
+
+        value = int32_t(uint32_t(data));
+        *result = ProbeState(int((data >> 32) & 0xFF) - 2);
+        return true;
+    }
+
+    template<TBType Type>
+    void store(const Position& pos, ProbeState result, int value) {
+
+        if (result == FAIL)
+            return;
+
+        const Key key = cache_key<Type>(pos);
+        const uint64_t data = uint64_t(uint32_t(value)) | uint64_t(result + 2) << 32;
+        Entry& e = table[key & (Size - 1)];
+        e.check.store(key ^ data, std::memory_order_relaxed);
+        e.data.store(data, std::memory_order_relaxed);
+    }
+
+    void clear() {
+        for (Entry& e : table)
+            e.check.store(0, std::memory_order_relaxed), e.data.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    Entry table[Size];
+};
+
+ProbeCache ProbeCache;
+
+int do_probe_dtz(Position& pos, ProbeState* result);
+
 } // namespace
 
 
@@ -1261,6 +1343,7 @@ WDLScore search(Position& pos, ProbeState* result) {
 void Tablebases::init(const std::string& paths) {
 
     TBTables.clear();
+    ProbeCache.clear();
     MaxCardinality = 0;
     TBFile::Paths = paths;
 
@@ -1400,6 +1483,83 @@ void Tablebases::init(const std::string& paths) {
     }
 
     sync_cout << "info string Found " << TBTables.size() << " tablebases" << sync_endl;
+
+    if (Options["SyzygyWarmup"])
+        warmup(size_t(int(Options["SyzygyPreload"])));
+}
+
+/// Tablebases::warmup() maps all the files found by init() at once, in parallel
+/// on the task pool, rather than each at its first probe from the search. Then
+/// up to preloadMB of their data, WDL tables first, is read in, so that on slow
+/// storage the page faults happen here and not in the middle of a game.
+void Tablebases::warmup(size_t preloadMB) {
+
+    const TimePoint start = now();
+    const size_t count = TBTables.size();
+    std::atomic<uint64_t> files(0), mappedBytes(0);
+
+    Threads.tasks.parallel_for(2 * count, [&](size_t i) {
+
+        uint64_t size = 0;
+        if (i < count)
+            size = mapped(TBTables.at<WDL>(i)) ? TBTables.at<WDL>(i).size : 0;
+        else
+            size = mapped(TBTables.at<DTZ>(i - count)) ? TBTables.at<DTZ>(i - count).size : 0;
+
+        if (size)
+        {
+            files += 1;
+            mappedBytes += size;
+        }
+    });
+
+    // Split the data to read in chunks small enough to share among the
+    // threads, up to the budget.
+    constexpr uint64_t ChunkSize = 16 * 1024 * 1024;
+    std::vector<std::pair<uint8_t*, uint64_t>> chunks;
+    uint64_t budget = uint64_t(preloadMB) * 1024 * 1024;
+
+    auto add = [&](void* baseAddress, uint64_t size) {
+        for (uint64_t offset = 0; baseAddress && offset < size && budget; offset += ChunkSize)
+        {
+            const uint64_t len = std::min({ ChunkSize, size - offset, budget });
+            chunks.emplace_back((uint8_t*)baseAddress + offset, len);
+            budget -= len;
+        }
+    };
+
+    for (size_t i = 0; i < count; ++i)
+        add(TBTables.at<WDL>(i).baseAddress, TBTables.at<WDL>(i).size);
+
+    for (size_t i = 0; i < count; ++i)
+        add(TBTables.at<DTZ>(i).baseAddress, TBTables.at<DTZ>(i).size);
+
+#ifndef _WIN32
+    // Start the read-ahead of the whole range at once, the files are mapped
+    // with MADV_RANDOM which would otherwise fault in a page at a time.
+    for (const auto& [data, len] : chunks)
+        madvise(data, len, MADV_WILLNEED);
+#endif
+
+    // Touch every page, so that the data is actually in memory when done
+    std::atomic<uint64_t> preloadedBytes(0), checksum(0);
+
+    Threads.tasks.parallel_for(chunks.size(), [&](size_t i) {
+
+        const auto& [data, len] = chunks[i];
+        uint8_t sum = 0;
+
+        for (uint64_t offset = 0; offset < len; offset += 4096)
+            sum += data[offset];
+
+        checksum += sum;
+        preloadedBytes += len;
+    });
+
+    sync_cout << "info string Tablebase warm-up: " << files << " files, "
+              << (mappedBytes >> 20) << " MB mapped, "
+              << (preloadedBytes >> 20) << " MB preloaded in "
+              << now() - start << " ms" << sync_endl;
 }
 
 // Probe the WDL table for a particular position.
@@ -1412,8 +1572,14 @@ void Tablebases::init(const std::string& paths) {
 //  2 : win
 WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
 
+    int value;
+    if (ProbeCache.probe<WDL>(pos, result, value))
+        return WDLScore(value);
+
     *result = OK;
-    return search<false>(pos, result);
+    WDLScore wdl = search<false>(pos, result);
+    ProbeCache.store<WDL>(pos, *result, wdl);
+    return wdl;
 }
 
 // Probe the DTZ table for a particular position.
@@ -1444,6 +1610,21 @@ WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
 // then do not accept moves leading to dtz + 50-move-counter == 100.
 int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
 
+    int dtz;
+    if (ProbeCache.probe<DTZ>(pos, result, dtz))
+        return dtz;
+
+    dtz = do_probe_dtz(pos, result);
+    ProbeCache.store<DTZ>(pos, *result, dtz);
+    return dtz;
+}
+
+namespace {
+
+// do_probe_dtz() probes the DTZ table for a position not in the cache. The
+// 1-ply search goes through probe_dtz(), so the children are cached as well.
+int do_probe_dtz(Position& pos, ProbeState* result) {
+
     *result = OK;
     WDLScore wdl = search<true>(pos, result);
 
@@ -1504,6 +1685,8 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
     return minDTZ == 0xFFFF ? -1 : minDTZ;
 }
 
+} // namespace
+
 
 // Use the DTZ tables to rank root moves.
 //
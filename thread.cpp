@@ -19,6 +19,9 @@
 #include <cassert>
 
 #include <algorithm> // For std::count
+#include <chrono>
+#include <iomanip>
+#include <sstream>
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
@@ -28,6 +31,27 @@
 
 ThreadPool Threads; // Global object
 
+namespace {
+
+/// spin_until() busy-waits, for at most "Idle Spin" microseconds, until the
+/// condition holds. Waking up a spinning thread avoids the latency of the OS
+/// scheduler, at the price of the CPU time used for spinning.
+
+template<typename Condition>
+void spin_until(Condition condition) {
+
+  const int spin = Threads.idleSpin;
+  if (!spin)
+      return;
+
+  const auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(spin);
+
+  while (!condition() && std::chrono::steady_clock::now() < end)
+      std::this_thread::yield();
+}
+
+} // namespace
+
 
 /// Thread constructor launches the thread and waits until it goes to sleep
 /// in idle_loop(). Note that 'searching' and 'exit' should be already set.
@@ -97,6 +121,8 @@ void Thread::start_searching() {
 
 void Thread::wait_for_search_finished() {
 
+  spin_until([&]{ return !searching; });
+
   std::unique_lock<std::mutex> lk(mutex);
   cv.wait(lk, [&]{ return !searching; });
 }
@@ -112,25 +138,176 @@ void Thread::idle_loop() {
   // some Windows NUMA hardware, for instance in fishtest. To make it simple,
   // just check if running threads are below a threshold, in this case all this
   // NUMA machinery is not needed.
-  if (Options["Threads"] > 8)
-      WinProcGroup::bindThisThread(idx);
+  if (Threads.bind_to_nodes())
+      numaNode = size_t(std::max(WinProcGroup::bindThisThread(idx), 0));
 
   while (true)
   {
       std::unique_lock<std::mutex> lk(mutex);
       searching = false;
       cv.notify_one(); // Wake up anyone waiting for search finished
-      cv.wait(lk, [&]{ return searching; });
+      lk.unlock();
+
+      spin_until([&]{ return searching.load(); });
+
+      lk.lock();
+      cv.wait(lk, [&]{ return searching.load(); });
 
       if (exit)
           return;
 
       lk.unlock();
 
+      // Helpers wake up the next ones in the wake-up tree, then all threads
+      // set up their own root position in parallel.
+      if (idx)
+          Threads.start_searching(idx);
+
+      Threads.setup_root(this);
+
       search();
   }
 }
 
+/// new_thread() creates the search thread with index idx. When threads are
+/// bound to NUMA nodes, it is constructed and cleared by a helper thread bound
+/// to the same node, so that its tables are first touched on that node.
+
+template<typename T>
+static Thread* new_thread(size_t idx) {
+
+  if (!Threads.bind_to_nodes())
+      return new T(idx);
+
+  Thread* th = nullptr;
+  std::thread([&]() {
+      WinProcGroup::bindThisThread(idx);
+      th = new T(idx);
+      th->clear();
+  }).join();
+  return th;
+}
+
+
+/// TaskPool::Worker::idle_loop() runs the queued jobs. When the pool is resized
+/// the remaining jobs are run before the worker exits.
+
+void TaskPool::Worker::idle_loop() {
+
+  if (Threads.bind_to_nodes())
+      WinProcGroup::bindThisThread(idx);
+
+  std::unique_lock<std::mutex> lk(pool->mutex);
+
+  while (true)
+  {
+      ++pool->idle;
+      pool->cv.wait(lk, [&]{ return pool->exit || !pool->queue.empty(); });
+      --pool->idle;
+
+      if (pool->queue.empty())
+          return;
+
+      std::function<void()> job = std::move(pool->queue.front());
+      pool->queue.pop_front();
+
+      lk.unlock();
+      job();
+      lk.lock();
+  }
+}
+
+
+/// TaskPool::set() waits for the queued jobs and replaces the workers with the
+/// requested number of new ones.
+
+void TaskPool::set(size_t requested) {
+
+  {
+      std::lock_guard<std::mutex> lk(mutex);
+      exit = true;
+  }
+  cv.notify_all();
+
+  for (auto& w : workers)
+      w->stdThread.join();
+
+  std::lock_guard<std::mutex> lk(mutex);
+  workers.clear();
+  exit = false;
+
+  while (workers.size() < requested)
+      workers.push_back(std::make_unique<Worker>(this, workers.size()));
+}
+
+
+/// TaskPool::size() returns the current number of workers
+
+size_t TaskPool::size() {
+
+  std::lock_guard<std::mutex> lk(mutex);
+  return workers.size();
+}
+
+
+/// TaskPool::push() queues a job, adding a worker if none is left to take it
+
+void TaskPool::push(std::function<void()>&& job) {
+
+  {
+      std::lock_guard<std::mutex> lk(mutex);
+      queue.push_back(std::move(job));
+
+      if (queue.size() > idle)
+          workers.push_back(std::make_unique<Worker>(this, workers.size()));
+  }
+  cv.notify_one();
+}
+
+
+/// TaskPool::parallel_for() calls f(0) ... f(count - 1) on the workers and
+/// returns when all the calls are done. The calling thread takes its share of
+/// the work, so it is safe to use from a job.
+
+void TaskPool::parallel_for(size_t count, const std::function<void(size_t)>& f) {
+
+  struct State {
+    std::function<void(size_t)> f;
+    size_t count;
+    std::atomic<size_t> next{0}, done{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+
+  // The helpers may start after the last call is done, so they share the state
+  auto state = std::make_shared<State>();
+  state->f = f;
+  state->count = count;
+
+  auto run = [state]() {
+      for (size_t i; (i = state->next++) < state->count; )
+      {
+          state->f(i);
+
+          if (++state->done == state->count)
+          {
+              std::lock_guard<std::mutex> lk(state->mutex);
+              state->cv.notify_all();
+          }
+      }
+  };
+
+  const size_t helpers = std::min(count, size());
+  for (size_t n = 1; n < helpers; ++n)
+      push(run);
+
+  run();
+
+  std::unique_lock<std::mutex> lk(state->mutex);
+  state->cv.wait(lk, [&]{ return state->done == state->count; });
+}
+
+
 /// ThreadPool::set() creates/destroys threads to match the requested number.
 /// Created and launched threads will immediately go to sleep in idle_loop.
 /// Upon resizing, threads are recreated to allow for binding if necessary.
@@ -144,11 +321,13 @@ void ThreadPool::set(size_t requested) {
           delete back(), pop_back();
   }
 
+  tasks.set(requested);
+
   if (requested > 0) { // create new thread(s)
-      push_back(new MainThread(0));
+      push_back(new_thread<MainThread>(0));
 
       while (size() < requested)
-          push_back(new Thread(size()));
+          push_back(new_thread<Thread>(size()));
       clear();
 
       // Reallocate the hash with the new threadpool size
@@ -160,6 +339,17 @@ void ThreadPool::set(size_t requested) {
 }
 
 
+/// ThreadPool::bind_to_nodes() tells whether search threads are bound to the
+/// NUMA nodes. With the default "auto" policy, only when more than 8 threads
+/// are used, so that many single-threaded processes are left to the OS.
+
+bool ThreadPool::bind_to_nodes() const {
+
+  return   Options["NUMA Policy"] == "bind"
+        || (Options["NUMA Policy"] == "auto" && Options["Threads"] > 8);
+}
+
+
 /// ThreadPool::clear() sets threadPool data to initial values
 
 void ThreadPool::clear() {
@@ -192,6 +382,10 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
           || std::count(limits.searchmoves.begin(), limits.searchmoves.end(), m))
           rootMoves.emplace_back(m);
 
+  // The root probes are counted by the tablebase cache statistics
+  for (Thread* th : *this)
+      th->tbCacheHits = th->tbCacheMisses = 0;
+
   if (!rootMoves.empty())
       Tablebases::rank_root_moves(pos, rootMoves);
 
@@ -202,23 +396,40 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   if (states.get())
       setupStates = std::move(states); // Ownership transfer, states is now empty
 
-  // We use Position::set() to set root position across threads. But there are
-  // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
-  // be deduced from a fen string, so set() clears them and they are set from
-  // setupStates->back() later. The rootState is per thread, earlier states are shared
-  // since they are read-only.
+  // The root position and moves are copied by each thread with setup_root()
+  // when it starts searching, only the counters are reset here.
+  setupFen = pos.fen();
+  setupChess960 = pos.is_chess960();
+  setupRootMoves = rootMoves;
+
   for (Thread* th : *this)
   {
       th->nodes = th->tbHits = th->nmpMinPly = th->bestMoveChanges = 0;
       th->rootDepth = th->completedDepth = 0;
-      th->rootMoves = rootMoves;
-      th->rootPos.set(pos.fen(), pos.is_chess960(), &th->rootState, th);
-      th->rootState = setupStates->back();
+#if defined(USE_STATS)
+      th->stats = SearchStats();
+#endif
   }
 
   main()->start_searching();
 }
 
+
+/// ThreadPool::setup_root() sets the root position and moves of a thread for
+/// the search started by start_thinking().
+
+void ThreadPool::setup_root(Thread* th) const {
+
+  // We use Position::set() to set root position across threads. But there are
+  // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
+  // be deduced from a fen string, so set() clears them and they are set from
+  // setupStates->back() later. The rootState is per thread, earlier states are shared
+  // since they are read-only.
+  th->rootMoves = setupRootMoves;
+  th->rootPos.set(setupFen, setupChess960, &th->rootState, th);
+  th->rootState = setupStates->back();
+}
+
 Thread* ThreadPool::get_best_thread() const {
 
     Thread* bestThread = front();
@@ -251,13 +462,14 @@ Thread* ThreadPool::get_best_thread() const {
 }
 
 
-/// Start non-main threads
+/// Start non-main threads. The threads are woken up along a binary tree, the
+/// main thread wakes up the first two helpers and each helper the next two, so
+/// that the latency grows with the logarithm of the number of threads.
 
-void ThreadPool::start_searching() {
+void ThreadPool::start_searching(size_t parent) {
 
-    for (Thread* th : *this)
-        if (th != front())
-            th->start_searching();
+    for (size_t child = 2 * parent + 1; child <= 2 * parent + 2 && child < size(); ++child)
+        at(child)->start_searching();
 }
 
 
@@ -269,3 +481,79 @@ void ThreadPool::wait_for_search_finished() const {
         if (th != front())
             th->wait_for_search_finished();
 }
+
+
+#if defined(USE_STATS)
+
+SearchStats& SearchStats::operator+=(const SearchStats& s) {
+
+  qnodes        += s.qnodes;
+  ttHits        += s.ttHits;
+  evaluations   += s.evaluations;
+  nnueUpdates   += s.nnueUpdates;
+  nnueRefreshes += s.nnueRefreshes;
+  evalTicks     += s.evalTicks;
+  pickerTicks   += s.pickerTicks;
+  searchTicks   += s.searchTicks;
+  searchTime    += s.searchTime;
+
+  for (size_t i = 0; i < 8; ++i)
+      cutoffs[i] += s.cutoffs[i];
+
+  return *this;
+}
+
+#endif
+
+
+/// ThreadPool::stats() returns the counters of the current or last search as
+/// "info string" lines: the node rate of each thread, then the counters of all
+/// the threads. Like "hashstats", it does not wait for the search to finish.
+
+std::string ThreadPool::stats() const {
+
+  std::stringstream ss;
+
+#if defined(USE_STATS)
+  SearchStats total = SearchStats();
+  uint64_t nodes = 0;
+
+  auto percent = [](uint64_t part, uint64_t whole) {
+      std::stringstream p;
+      p << std::fixed << std::setprecision(1) << (whole ? 100.0 * part / whole : 0.0) << "%";
+      return p.str();
+  };
+
+  for (size_t i = 0; i < size(); ++i)
+  {
+      const Thread* th = at(i);
+      const uint64_t n = th->nodes.load(std::memory_order_relaxed);
+      ss << "info string thread " << i << " nodes " << n
+         << " nps " << n * 1000 / std::max(th->stats.searchTime, TimePoint(1)) << "\n";
+      total += th->stats;
+      nodes += n;
+  }
+
+  uint64_t cutoffs = 0;
+  for (uint64_t c : total.cutoffs)
+      cutoffs += c;
+
+  ss << "info string nodes " << nodes
+     << " qnodes " << total.qnodes << " (" << percent(total.qnodes, nodes) << ")"
+     << " tthits " << total.ttHits << " (" << percent(total.ttHits, nodes) << ")\n"
+     << "info string evaluations " << total.evaluations
+     << " nnue updates " << total.nnueUpdates
+     << " refreshes " << total.nnueRefreshes << "\n"
+     << "info string cutoffs " << cutoffs << " by move number";
+
+  for (size_t i = 0; i < 8; ++i)
+      ss << " " << i + 1 << (i == 7 ? "+ " : " ") << percent(total.cutoffs[i], cutoffs);
+
+  ss << "\ninfo string time in eval " << percent(total.evalTicks, total.searchTicks)
+     << " in move picking " << percent(total.pickerTicks, total.searchTicks);
+#else
+  ss << "info string Search statistics are not compiled in, build with stats=yes";
+#endif
+
+  return ss.str();
+}
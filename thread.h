@@ -20,7 +20,12 @@
 #define THREAD_H_INCLUDED
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -33,6 +38,41 @@
 #include "thread_win32_osx.h"
 
 
+#if defined(USE_STATS)
+
+/// SearchStats holds the counters of a thread, compiled in with USE_STATS.
+/// They are only written by their own thread and summed by the ThreadPool.
+
+struct SearchStats {
+
+  // Timer adds the ticks spent in its scope to a counter
+  struct Timer {
+    explicit Timer(uint64_t& c) : counter(c), start(ticks()) {}
+    ~Timer() { counter += ticks() - start; }
+
+    uint64_t& counter;
+    uint64_t start;
+  };
+
+  static uint64_t ticks() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_ia32_rdtsc();
+#else
+    return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+  }
+
+  SearchStats& operator+=(const SearchStats& s);
+
+  uint64_t qnodes, ttHits, evaluations, nnueUpdates, nnueRefreshes;
+  uint64_t cutoffs[8]; // Beta cutoffs by move number, the last one for later moves
+  uint64_t evalTicks, pickerTicks, searchTicks;
+  TimePoint searchTime;
+};
+
+#endif
+
+
 /// Thread class keeps together all the thread-related stuff. We use
 /// per-thread pawn and material hash tables so that once we get a
 /// pointer to an entry its life time is unlimited and we don't have
@@ -43,7 +83,8 @@ class Thread {
   std::mutex mutex;
   std::condition_variable cv;
   size_t idx;
-  bool exit = false, searching = true; // Set before starting std::thread
+  bool exit = false; // Set before starting std::thread
+  std::atomic_bool searching = { true }; // Written under the mutex, read when spinning
   NativeThread stdThread;
 
 public:
@@ -62,7 +103,12 @@ public:
   uint64_t ttHitAverage;
   int selDepth, nmpMinPly;
   Color nmpColor;
+  size_t numaNode = 0;
   std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
+  std::atomic<uint64_t> tbCacheHits, tbCacheMisses;
+#if defined(USE_STATS)
+  SearchStats stats;
+#endif
 
   Position rootPos;
   StateInfo rootState;
@@ -74,6 +120,13 @@ public:
   CapturePieceToHistory captureHistory;
   ContinuationHistory continuationHistory[2][2];
   Score contempt;
+
+#if defined(EVAL_LEARN)
+  // Limits of the Learner::search() running on this thread, nullptr outside
+  // of it, and whether the search used up its node budget
+  const Learner::SearchLimits* learnerLimits = nullptr;
+  bool learnerStop = false;
+#endif
 };
 
 
@@ -95,6 +148,50 @@ struct MainThread : public Thread {
 };
 
 
+/// TaskPool runs general-purpose jobs, like clearing the hash or the learner's
+/// workers and file I/O, on long-lived worker threads so that no thread is
+/// created per job. It is owned by the ThreadPool and has as many workers as
+/// search threads, but it grows when more jobs are queued than workers are
+/// idle, so that long-running jobs cannot starve the others.
+
+class TaskPool {
+
+  struct Worker {
+    Worker(TaskPool* p, size_t n) : pool(p), idx(n), stdThread(&Worker::idle_loop, this) {}
+    void idle_loop();
+
+    TaskPool* pool;
+    size_t idx;
+    NativeThread stdThread;
+  };
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::function<void()>> queue;
+  std::vector<std::unique_ptr<Worker>> workers;
+  size_t idle = 0;
+  bool exit = false;
+
+  void push(std::function<void()>&&);
+
+public:
+  ~TaskPool() { set(0); }
+  void set(size_t);
+  size_t size();
+  void parallel_for(size_t count, const std::function<void(size_t)>& f);
+
+  // Queue a job and return a future for its result
+  template<typename F>
+  auto submit(F&& f) -> std::future<decltype(f())> {
+
+    auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::forward<F>(f));
+    std::future<decltype(f())> result = task->get_future();
+    push([task]() { (*task)(); });
+    return result;
+  }
+};
+
+
 /// ThreadPool struct handles all the threads-related stuff like init, starting,
 /// parking and, most importantly, launching a thread. All the access to threads
 /// is done through this class.
@@ -108,14 +205,24 @@ struct ThreadPool : public std::vector<Thread*> {
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
   uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
   uint64_t tb_hits()        const { return accumulate(&Thread::tbHits); }
+  uint64_t tb_cache_hits()   const { return accumulate(&Thread::tbCacheHits); }
+  uint64_t tb_cache_misses() const { return accumulate(&Thread::tbCacheMisses); }
   Thread* get_best_thread() const;
-  void start_searching();
+  void start_searching(size_t parent = 0);
   void wait_for_search_finished() const;
+  void setup_root(Thread*) const;
+  bool bind_to_nodes() const;
+  std::string stats() const;
 
   std::atomic_bool stop, increaseDepth;
+  std::atomic_int idleSpin; // Microseconds to spin before blocking when idle
+  TaskPool tasks;
 
 private:
   StateListPtr setupStates;
+  std::string setupFen;
+  bool setupChess960;
+  Search::RootMoves setupRootMoves;
 
   uint64_t accumulate(std::atomic<uint64_t> Thread::* member) const {
 
@@ -16,9 +16,16 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cstring>   // For std::memset
+#include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <thread>
+#include <sstream>
+
+#if defined(USE_TT_BUCKET) && defined(USE_SSE2)
+#include <emmintrin.h> // For the SIMD key match in probe()
+#endif
 
 #include "bitboard.h"
 #include "misc.h"
@@ -37,24 +44,54 @@ bool TranspositionTable::enable_transposition_table = true;
 
 void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
 
+#if defined(USE_TT_XOR)
+  // Work on a copy, so that the data is written back as a single 64 bit word
+  TTEntry e = *this;
+  const bool sameKey = e.key() == k;
+#else
+  TTEntry& e = *this;
+#if defined(USE_TT_BUCKET)
+  uint16_t& entryKey16 = cluster_key16();
+#else
+  uint16_t& entryKey16 = key16;
+#endif
+  const bool sameKey = (uint16_t)k == entryKey16;
+#endif
+
   // Preserve any existing move for the same position
-  if (m || (uint16_t)k != key16)
-      move16 = (uint16_t)m;
+  if (m || !sameKey)
+      e.move16 = (uint16_t)m;
 
   // Overwrite less valuable entries (cheapest checks first)
   if (b == BOUND_EXACT
-      || (uint16_t)k != key16
-      || d - DEPTH_OFFSET > depth8 - 4)
+      || !sameKey
+      || d - DEPTH_OFFSET > e.depth8 - 4)
   {
       assert(d > DEPTH_OFFSET);
       assert(d < 256 + DEPTH_OFFSET);
 
-      key16     = (uint16_t)k;
-      depth8    = (uint8_t)(d - DEPTH_OFFSET);
-      genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
-      value16   = (int16_t)v;
-      eval16    = (int16_t)ev;
+#if !defined(USE_TT_XOR)
+      entryKey16  = (uint16_t)k;
+#endif
+      e.depth8    = (uint8_t)(d - DEPTH_OFFSET);
+      e.genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
+      e.value16   = (int16_t)v;
+      e.eval16    = (int16_t)ev;
   }
+
+#if defined(USE_TT_XOR)
+  store(k, e);
+#endif
+}
+
+
+/// TranspositionTable::release() frees the table, allocated or mapped
+
+void TranspositionTable::release() {
+
+  aligned_ttmem_free(mem);
+  unmap_file(mappedFile, mappedSize);
+  mem = mappedFile = nullptr;
 }
 
 
@@ -66,10 +103,11 @@ void TranspositionTable::resize(size_t mbSize) {
 
   Threads.main()->wait_for_search_finished();
 
-  aligned_ttmem_free(mem);
+  release();
 
   clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
-  table = static_cast<Cluster*>(aligned_ttmem_alloc(clusterCount * sizeof(Cluster), mem));
+  table = static_cast<Cluster*>(aligned_ttmem_alloc(clusterCount * sizeof(Cluster), mem,
+                                                     bool(Options["Large Pages"])));
   if (!mem)
   {
       std::cerr << "Failed to allocate " << mbSize
@@ -78,6 +116,7 @@ void TranspositionTable::resize(size_t mbSize) {
   }
 
   clear();
+  aligned_ttmem_report(mem);
 }
 
 
@@ -86,58 +125,122 @@ void TranspositionTable::resize(size_t mbSize) {
 
 void TranspositionTable::clear() {
 
-  std::vector<std::thread> threads;
+  const size_t threadCount = size_t(Options["Threads"]);
 
-  for (size_t idx = 0; idx < Options["Threads"]; ++idx)
-  {
-      threads.emplace_back([this, idx]() {
-
-          // Thread binding gives faster search on systems with a first-touch policy
-          if (Options["Threads"] > 8)
-              WinProcGroup::bindThisThread(idx);
+  Threads.tasks.parallel_for(threadCount, [this, threadCount](size_t idx) {
 
-          // Each thread will zero its part of the hash table
-          const size_t stride = size_t(clusterCount / Options["Threads"]),
-                       start  = size_t(stride * idx),
-                       len    = idx != Options["Threads"] - 1 ?
-                                stride : clusterCount - start;
+      // Each job will zero its part of the hash table. The workers are bound
+      // like the search threads, which gives faster search on systems with a
+      // first-touch policy.
+      const size_t stride = size_t(clusterCount / threadCount),
+                   start  = size_t(stride * idx),
+                   len    = idx != threadCount - 1 ?
+                            stride : clusterCount - start;
 
-          std::memset(&table[start], 0, len * sizeof(Cluster));
-      });
-  }
+      std::memset(&table[start], 0, len * sizeof(Cluster));
+  });
 
-  for (std::thread& th : threads)
-      th.join();
+  rejectedProbes = 0;
 }
 
 
 /// TranspositionTable::probe() looks up the current position in the transposition
 /// table. It returns true and a pointer to the TTEntry if the position is found.
 /// Otherwise, it returns false and a pointer to an empty or least valuable TTEntry
-/// to be replaced later. The replace value of an entry is calculated as its depth
+/// to be replaced later. The entry is copied to 'data', which is what the caller
+/// should read: the table itself may be changed by other threads at any time. The replace value of an entry is calculated as its depth
 /// minus 8 times its relative age. TTEntry t1 is considered more valuable than
 /// TTEntry t2 if its replace value is greater than that of t2.
 
-TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
+TTEntry* TranspositionTable::probe(const Key key, bool& found, TTEntry& data) const {
 
 #ifdef EVAL_LEARN
   if (!enable_transposition_table) {
       found = false;
+      data = TTEntry();
       return first_entry(0);
   }
 #endif
 
   TTEntry* const tte = first_entry(key);
+
+#if defined(USE_TT_BUCKET)
+  const Cluster& cluster = table[mul_hi64(key, clusterCount)];
+  const uint16_t key16 = (uint16_t)key;
+
+  // Find a matching key. An empty entry has a zero key and depth, so when
+  // it matches it is returned as not found, ready to be written.
+#if defined(USE_SSE2)
+  const __m128i keys = _mm_load_si128(reinterpret_cast<const __m128i*>(cluster.key16));
+  const unsigned match = unsigned(_mm_movemask_epi8(
+      _mm_cmpeq_epi16(keys, _mm_set1_epi16(short(key16))))) & ((1u << (2 * ClusterSize)) - 1);
+#else
+  unsigned match = 0;
+  for (int i = 0; i < ClusterSize; ++i)
+      match |= unsigned(cluster.key16[i] == key16) << (2 * i);
+#endif
+
+  if (match)
+  {
+      const int i = int(lsb(match)) / 2;
+      tte[i].genBound8 = uint8_t(generation8 | (tte[i].genBound8 & 0x7)); // Refresh
+      data = tte[i];
+
+      return found = (bool)data.depth8, &tte[i];
+  }
+
+#elif defined(USE_TT_XOR)
+  for (int i = 0; i < ClusterSize; ++i)
+  {
+      TTEntry e = tte[i]; // Check and refresh a snapshot of the entry
+      const Key entryKey = e.key();
+
+      if (entryKey == key || !e.depth8)
+      {
+          // Refresh. The write back may overwrite a concurrent save() with the
+          // older data, so it is only done once per search.
+          if ((e.genBound8 & 0xF8) != generation8)
+          {
+              e.genBound8 = uint8_t(generation8 | (e.genBound8 & 0x7));
+              tte[i].store(entryKey, e);
+          }
+          data = e;
+
+          return found = (bool)e.depth8, &tte[i];
+      }
+
+      if ((uint16_t)entryKey == (uint16_t)key)
+          rejectedProbes.fetch_add(1, std::memory_order_relaxed);
+  }
+#else
   const uint16_t key16 = (uint16_t)key;  // Use the low 16 bits as key inside the cluster
 
   for (int i = 0; i < ClusterSize; ++i)
       if (tte[i].key16 == key16 || !tte[i].depth8)
       {
           tte[i].genBound8 = uint8_t(generation8 | (tte[i].genBound8 & 0x7)); // Refresh
+          data = tte[i];
 
-          return found = (bool)tte[i].depth8, &tte[i];
+          return found = (bool)data.depth8, &tte[i];
       }
+#endif
 
+#if defined(USE_TT_BUCKET)
+  // Find an entry to be replaced, preferring empty ones, with the same
+  // replacement strategy as below but without branches.
+  auto value = [this](const TTEntry& e) {
+      return e.depth8 - ((263 + generation8 - e.genBound8) & 0xF8) - (e.depth8 ? 0 : 1024);
+  };
+
+  TTEntry* replace = tte;
+  int replaceValue = value(tte[0]);
+  for (int i = 1; i < ClusterSize; ++i)
+  {
+      const int v = value(tte[i]);
+      replace = v < replaceValue ? &tte[i] : replace;
+      replaceValue = std::min(v, replaceValue);
+  }
+#else
   // Find an entry to be replaced according to the replacement strategy
   TTEntry* replace = tte;
   for (int i = 1; i < ClusterSize; ++i)
@@ -148,6 +251,9 @@ TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
       if (  replace->depth8 - ((263 + generation8 - replace->genBound8) & 0xF8)
           >   tte[i].depth8 - ((263 + generation8 -   tte[i].genBound8) & 0xF8))
           replace = &tte[i];
+#endif
+
+  data = *replace;
 
   return found = false, replace;
 }
@@ -155,13 +261,284 @@ TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
 
 /// TranspositionTable::hashfull() returns an approximation of the hashtable
 /// occupation during a search. The hash is x permill full, as per UCI protocol.
+/// The 1000 sampled clusters are spread over the whole table, because the
+/// occupation of its first clusters is not representative.
 
 int TranspositionTable::hashfull() const {
 
+  const size_t stride = std::max(clusterCount / 1000, size_t(1));
+
   int cnt = 0;
-  for (int i = 0; i < 1000; ++i)
+  for (size_t i = 0; i < 1000 * stride; i += stride)
       for (int j = 0; j < ClusterSize; ++j)
           cnt += table[i].entry[j].depth8 && (table[i].entry[j].genBound8 & 0xF8) == generation8;
 
   return cnt / ClusterSize;
 }
+
+
+/// TranspositionTable::stats() scans the whole table in parallel, like clear(),
+/// and returns a report of its occupancy by age, depth and bound type. It takes
+/// no lock and does not wait for the search, so it can be used while searching:
+/// entries saved concurrently are then counted in their old or new state.
+
+std::string TranspositionTable::stats(size_t threadCount) const {
+
+  struct Counts {
+    uint64_t entries = 0, pv = 0;
+    uint64_t age[32] = {}, depth[256] = {}, bound[4] = {};
+  };
+
+  threadCount = std::max(std::min(threadCount, clusterCount), size_t(1));
+  std::vector<Counts> counts(threadCount);
+  TimePoint elapsed = now();
+
+  Threads.tasks.parallel_for(threadCount, [this, threadCount, &counts](size_t idx) {
+
+      // Each job scans its part of the table into its own counts
+      const size_t stride = clusterCount / threadCount,
+                   start  = stride * idx,
+                   end    = idx != threadCount - 1 ? start + stride : clusterCount;
+
+      Counts& c = counts[idx];
+      for (size_t i = start; i < end; ++i)
+          for (const TTEntry& e : table[i].entry)
+              if (e.depth8)
+              {
+                  c.entries++;
+                  c.age[((263 + generation8 - e.genBound8) & 0xF8) >> 3]++;
+                  c.depth[e.depth8]++;
+                  c.bound[e.bound()]++;
+                  c.pv += e.is_pv();
+              }
+  });
+
+  elapsed = now() - elapsed;
+
+  Counts total;
+  for (const Counts& c : counts)
+  {
+      total.entries += c.entries;
+      total.pv += c.pv;
+      for (int i = 0; i < 32; ++i)
+          total.age[i] += c.age[i];
+      for (int i = 0; i < 256; ++i)
+          total.depth[i] += c.depth[i];
+      for (int i = 0; i < 4; ++i)
+          total.bound[i] += c.bound[i];
+  }
+
+  const uint64_t size = clusterCount * ClusterSize;
+  auto percent = [](uint64_t n, uint64_t d) {
+      std::stringstream ss;
+      ss << std::fixed << std::setprecision(1) << 100.0 * n / std::max(d, uint64_t(1)) << "%";
+      return ss.str();
+  };
+
+  std::stringstream ss;
+  ss << "Hash: " << clusterCount * sizeof(Cluster) / (1024 * 1024) << " MB, "
+     << size << " entries, scanned by " << threadCount << " threads in " << elapsed << " ms"
+     << "\nOccupied: " << total.entries << " entries (" << percent(total.entries, size) << ")"
+     << "\n\nAge (searches ago)";
+
+  for (int i = 0; i < 32; ++i)
+      if (total.age[i])
+          ss << "\n" << std::setw(5) << i << std::setw(12) << total.age[i]
+             << std::setw(8) << percent(total.age[i], total.entries);
+
+  ss << "\n\nDepth";
+  for (int i = 0; i < 256; ++i)
+      if (total.depth[i])
+          ss << "\n" << std::setw(5) << i + DEPTH_OFFSET << std::setw(12) << total.depth[i]
+             << std::setw(8) << percent(total.depth[i], total.entries);
+
+  ss << "\n\nBound"
+     << "\nexact" << std::setw(12) << total.bound[BOUND_EXACT] << std::setw(8) << percent(total.bound[BOUND_EXACT], total.entries)
+     << "\nlower" << std::setw(12) << total.bound[BOUND_LOWER] << std::setw(8) << percent(total.bound[BOUND_LOWER], total.entries)
+     << "\nupper" << std::setw(12) << total.bound[BOUND_UPPER] << std::setw(8) << percent(total.bound[BOUND_UPPER], total.entries)
+     << "\nnone " << std::setw(12) << total.bound[BOUND_NONE]  << std::setw(8) << percent(total.bound[BOUND_NONE],  total.entries)
+     << "\npv   " << std::setw(12) << total.pv                 << std::setw(8) << percent(total.pv, total.entries);
+
+  return ss.str();
+}
+
+
+namespace {
+
+  // Header of a hash file written by TranspositionTable::save(). A dense file
+  // holds the whole cluster array from HashFileDataOffset on, so that it can
+  // be mapped as the table. A sparse one holds runs of non-empty clusters, each
+  // preceded by its first index and length, and ends with an empty run.
+  struct HashFileHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t clusterSize;
+    uint64_t clusterCount;
+    uint32_t sparse;
+    uint32_t generation8;
+    uint32_t layout;
+  };
+
+  constexpr char HashFileMagic[8] = "SFHASH2";
+
+  // Entry layout of the clusters. The ttxor and ttbucket clusters have the
+  // same size, so a file of one of them is told apart by this id.
+#if defined(USE_TT_XOR)
+  constexpr uint32_t HashFileLayout = 1;
+#elif defined(USE_TT_BUCKET)
+  constexpr uint32_t HashFileLayout = 2;
+#else
+  constexpr uint32_t HashFileLayout = 0;
+#endif
+  constexpr uint32_t HashFileByteOrder = 0x01020304;
+  constexpr size_t HashFileDataOffset = 4096;
+
+  // Files are read and written in large sequential blocks
+  constexpr size_t HashFileBlockSize = 64 * 1024 * 1024;
+
+  void write_block(std::ostream& os, const void* data, size_t size) {
+    for (size_t done = 0; done < size; done += HashFileBlockSize)
+        os.write(static_cast<const char*>(data) + done, std::streamsize(std::min(size - done, HashFileBlockSize)));
+  }
+
+  void read_block(std::istream& is, void* data, size_t size) {
+    for (size_t done = 0; done < size && is; done += HashFileBlockSize)
+        is.read(static_cast<char*>(data) + done, std::streamsize(std::min(size - done, HashFileBlockSize)));
+  }
+}
+
+
+/// TranspositionTable::save() writes the table and its generation to a file.
+/// Sparse files skip the empty clusters, so they are smaller for a table that
+/// is not full, but they can not be mapped by load().
+
+bool TranspositionTable::save(const std::string& fileName, bool sparse) const {
+
+  Threads.main()->wait_for_search_finished();
+
+  std::ofstream file(fileName, std::ios::binary);
+
+  HashFileHeader header = {};
+  std::memcpy(header.magic, HashFileMagic, sizeof(HashFileMagic));
+  header.byteOrder = HashFileByteOrder;
+  header.clusterSize = uint32_t(sizeof(Cluster));
+  header.clusterCount = clusterCount;
+  header.sparse = sparse;
+  header.generation8 = generation8;
+  header.layout = HashFileLayout;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  if (!sparse)
+  {
+      const std::vector<char> padding(HashFileDataOffset - sizeof(header));
+      file.write(padding.data(), std::streamsize(padding.size()));
+      write_block(file, table, clusterCount * sizeof(Cluster));
+  }
+  else
+  {
+      auto empty = [](const Cluster& c) {
+          return std::all_of(c.entry, c.entry + ClusterSize, [](const TTEntry& e) { return !e.depth8; });
+      };
+
+      for (uint64_t start = 0, end; start < clusterCount; start = end)
+      {
+          while (start < clusterCount && empty(table[start]))
+              ++start;
+
+          for (end = start; end < clusterCount && !empty(table[end]); ++end) {}
+
+          if (end > start)
+          {
+              const uint64_t run[] = { start, end - start };
+              file.write(reinterpret_cast<const char*>(run), sizeof(run));
+              write_block(file, &table[start], (end - start) * sizeof(Cluster));
+          }
+      }
+
+      const uint64_t last[] = { 0, 0 };
+      file.write(reinterpret_cast<const char*>(last), sizeof(last));
+  }
+
+  return bool(file.flush());
+}
+
+
+/// TranspositionTable::load() reads a file written by save(). The current table
+/// must have the same size. A dense file can instead be mapped copy-on-write,
+/// so that the table is available at once and pages are read on first access.
+
+bool TranspositionTable::load(const std::string& fileName, bool mapped) {
+
+  Threads.main()->wait_for_search_finished();
+
+  std::ifstream file(fileName, std::ios::binary);
+  HashFileHeader header;
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+  if (   !file
+      || std::memcmp(header.magic, HashFileMagic, sizeof(HashFileMagic))
+      || header.byteOrder != HashFileByteOrder
+      || header.clusterSize != sizeof(Cluster)
+      || header.layout != HashFileLayout)
+  {
+      sync_cout << "info string " << fileName << " is not a hash file of this binary." << sync_endl;
+      return false;
+  }
+
+  if (header.clusterCount != clusterCount)
+  {
+      sync_cout << "info string " << fileName << " needs Hash "
+                << header.clusterCount * sizeof(Cluster) / (1024 * 1024) << " MB." << sync_endl;
+      return false;
+  }
+
+  if (mapped && !header.sparse)
+  {
+      size_t size = 0;
+      void* fileMem = map_file(fileName, size, true);
+      if (!fileMem || size < HashFileDataOffset + clusterCount * sizeof(Cluster))
+      {
+          unmap_file(fileMem, size);
+          sync_cout << "info string " << fileName << " could not be mapped." << sync_endl;
+          return false;
+      }
+
+      release();
+      mappedFile = fileMem;
+      mappedSize = size;
+      table = reinterpret_cast<Cluster*>(static_cast<char*>(mappedFile) + HashFileDataOffset);
+      generation8 = uint8_t(header.generation8);
+      return true;
+  }
+  else if (!header.sparse)
+  {
+      file.seekg(HashFileDataOffset);
+      read_block(file, table, clusterCount * sizeof(Cluster));
+  }
+  else
+  {
+      clear();
+
+      uint64_t run[2] = {};
+      while (file.read(reinterpret_cast<char*>(run), sizeof(run)) && run[1])
+      {
+          if (run[0] > clusterCount || run[1] > clusterCount - run[0])
+              break;
+
+          read_block(file, &table[run[0]], run[1] * sizeof(Cluster));
+      }
+
+      if (run[1])
+          file.setstate(std::ios::failbit);
+  }
+
+  if (!file)
+  {
+      clear();
+      sync_cout << "info string " << fileName << " is truncated or corrupt." << sync_endl;
+      return false;
+  }
+
+  generation8 = uint8_t(header.generation8);
+  return true;
+}
@@ -19,6 +19,9 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <atomic>
+#include <cstring>
+
 #include "misc.h"
 #include "types.h"
 
@@ -32,6 +35,15 @@
 /// move       16 bit
 /// value      16 bit
 /// eval value 16 bit
+///
+/// When compiled with USE_TT_BUCKET the key is not part of the 8 bytes entry,
+/// the keys of a cluster are packed together in its header instead.
+///
+/// When compiled with USE_TT_XOR the entry is 16 bytes instead: the full 64 bit
+/// key is stored XORed with the 64 bits of data that follow it. probe() checks
+/// the key on a snapshot of the entry and hands that snapshot to the caller, so
+/// an entry torn by a concurrent save(), as well as a different position with
+/// the same low key bits, fails the key check and is not reported as found.
 
 struct TTEntry {
 
@@ -46,7 +58,29 @@ struct TTEntry {
 private:
   friend class TranspositionTable;
 
+#if defined(USE_TT_XOR) && defined(USE_TT_BUCKET)
+#error "USE_TT_XOR and USE_TT_BUCKET are alternative layouts"
+#endif
+
+#if defined(USE_TT_BUCKET)
+  // The cluster is cache line aligned and its header holds the keys
+  uint16_t& cluster_key16() {
+    const uintptr_t cluster = uintptr_t(this) & ~uintptr_t(63);
+    return reinterpret_cast<uint16_t*>(cluster)[(uintptr_t(this) - cluster - 16) / 8];
+  }
+#elif defined(USE_TT_XOR)
+  uint64_t data64() const { uint64_t d; std::memcpy(&d, &depth8, sizeof(d)); return d; }
+  Key key() const { return keyXor64 ^ data64(); }
+  void store(Key k, const TTEntry& e) {
+    const uint64_t d = e.data64();
+    std::memcpy(&depth8, &d, sizeof(d));
+    keyXor64 = k ^ d;
+  }
+
+  uint64_t keyXor64;
+#elif !defined(USE_TT_BUCKET)
   uint16_t key16;
+#endif
   uint8_t  depth8;
   uint8_t  genBound8;
   uint16_t move16;
@@ -54,6 +88,12 @@ private:
   int16_t  eval16;
 };
 
+#if defined(USE_TT_XOR)
+static_assert(sizeof(TTEntry) == 16, "Unexpected TTEntry size");
+#elif defined(USE_TT_BUCKET)
+static_assert(sizeof(TTEntry) == 8, "Unexpected TTEntry size");
+#endif
+
 
 /// A TranspositionTable is an array of Cluster, of size clusterCount. Each
 /// cluster consists of ClusterSize number of TTEntry. Each non-empty TTEntry
@@ -63,6 +103,27 @@ private:
 
 class TranspositionTable {
 
+#if defined(USE_TT_BUCKET)
+  static constexpr int ClusterSize = 6;
+
+  // A whole cache line: the keys come first, so that they can be compared
+  // with a single SIMD instruction.
+  struct alignas(64) Cluster {
+    uint16_t key16[ClusterSize];
+    char padding[4]; // Pad the keys to 16 bytes
+    TTEntry entry[ClusterSize];
+  };
+
+  static_assert(sizeof(Cluster) == 64, "Unexpected Cluster size");
+#elif defined(USE_TT_XOR)
+  static constexpr int ClusterSize = 4;
+
+  struct Cluster {
+    TTEntry entry[ClusterSize];
+  };
+
+  static_assert(sizeof(Cluster) == 64, "Unexpected Cluster size");
+#else
   static constexpr int ClusterSize = 3;
 
   struct Cluster {
@@ -71,14 +132,19 @@ class TranspositionTable {
   };
 
   static_assert(sizeof(Cluster) == 32, "Unexpected Cluster size");
+#endif
 
 public:
- ~TranspositionTable() { aligned_ttmem_free(mem); }
+ ~TranspositionTable() { release(); }
   void new_search() { generation8 += 8; } // Lower 3 bits are used by PV flag and Bound
-  TTEntry* probe(const Key key, bool& found) const;
+  TTEntry* probe(const Key key, bool& found, TTEntry& data) const;
   int hashfull() const;
+  std::string stats(size_t threadCount) const;
+  uint64_t rejected() const { return rejectedProbes.load(std::memory_order_relaxed); }
   void resize(size_t mbSize);
   void clear();
+  bool save(const std::string& fileName, bool sparse) const;
+  bool load(const std::string& fileName, bool mapped);
 
   TTEntry* first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
@@ -91,10 +157,18 @@ public:
 private:
   friend struct TTEntry;
 
+  void release();
+
   size_t clusterCount;
   Cluster* table;
   void* mem;
+  void* mappedFile; // Set instead of mem when the table is a mapped hash file
+  size_t mappedSize;
   uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+
+  // Probes that matched the low 16 key bits of an entry, but not its full key:
+  // 16 bit collisions and torn entries. Only counted with USE_TT_XOR.
+  mutable std::atomic<uint64_t> rejectedProbes;
 };
 
 extern TranspositionTable TT;
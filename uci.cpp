@@ -16,11 +16,16 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include "evaluate.h"
 #include "movegen.h"
@@ -40,6 +45,7 @@
 using namespace std;
 
 extern vector<string> setup_bench(const Position&, istream&);
+extern void run_perft(Position&, istream&);
 
 // FEN string of the initial position, normal chess
 const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
@@ -53,6 +59,10 @@ void test_cmd(Position& pos, istringstream& is)
     is >> param;
 
     if (param == "nnue") Eval::NNUE::TestCommand(pos, is);
+#if defined(EVAL_LEARN)
+    else if (param == "sfen") Learner::test_sfen_packer(is);
+    else if (param == "qsearch") Learner::test_qsearch(is);
+#endif
 }
 
 namespace {
@@ -164,19 +174,17 @@ namespace {
   }
 
 
-  // bench() is called when engine receives the "bench" command. Firstly
-  // a list of UCI commands is setup according to bench parameters, then
-  // it is run one by one printing a summary at the end.
+  // run_bench() runs a list of commands set up by setup_bench() and returns
+  // the number of nodes searched and the time spent since the "ucinewgame".
 
-  void bench(Position& pos, istream& args, StateListPtr& states) {
+  uint64_t run_bench(Position& pos, const vector<string>& list, StateListPtr& states, TimePoint& elapsed) {
 
     string token;
     uint64_t num, nodes = 0, cnt = 1;
 
-    vector<string> list = setup_bench(pos, args);
     num = count_if(list.begin(), list.end(), [](string s) { return s.find("go ") == 0 || s.find("eval") == 0; });
 
-    TimePoint elapsed = now();
+    elapsed = now();
 
     for (const auto& cmd : list)
     {
@@ -202,12 +210,216 @@ namespace {
 
     elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
 
+    return nodes;
+  }
+
+
+  // bench_latency() is called when engine receives the "bench latency" command.
+  // The format is "bench latency [threads] [iterations] [ms]". Over the bench
+  // positions it measures the time from "go" until all the threads are
+  // searching, from "go depth 1" to the best move, which bounds the time to the
+  // first info line, and from "stop" to the best move of an infinite search
+  // stopped after the given number of milliseconds.
+
+  void bench_latency(Position& pos, istream& args, StateListPtr& states) {
+
+    using Clock = std::chrono::steady_clock;
+
+    string token;
+    string threads = (args >> token) ? token : to_string(int(Options["Threads"]));
+    int iterations = (args >> token) ? std::max(std::atoi(token.c_str()), 1) : 20;
+    int searchTime = (args >> token) ? std::max(std::atoi(token.c_str()), 1) : 100;
+
+    istringstream benchArgs(to_string(int(Options["Hash"])) + " " + threads + " 1 default depth");
+    vector<string> fens;
+    for (const string& cmd : setup_bench(pos, benchArgs))
+        if (cmd.find("position") == 0)
+            fens.push_back(cmd.substr(9));
+
+    istringstream threadArgs("name Threads value " + threads);
+    setoption(threadArgs);
+    Search::clear();
+
+    vector<int64_t> wake, firstInfo, stop;
+    auto micros = [](Clock::time_point from) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - from).count();
+    };
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        istringstream fen(fens[i % fens.size()]), depthOne("depth 1"), infinite("infinite");
+
+        position(pos, fen, states);
+        Clock::time_point start = Clock::now();
+        go(pos, depthOne, states);
+        Threads.main()->wait_for_search_finished();
+        firstInfo.push_back(micros(start));
+
+        start = Clock::now();
+        go(pos, infinite, states);
+        while (std::any_of(Threads.begin(), Threads.end(), [](Thread* th) { return !th->nodes; }))
+            std::this_thread::yield();
+        wake.push_back(micros(start));
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(searchTime));
+        start = Clock::now();
+        Threads.stop = true;
+        Threads.main()->wait_for_search_finished();
+        stop.push_back(micros(start));
+    }
+
+    auto summary = [](vector<int64_t>& v) {
+        std::sort(v.begin(), v.end());
+        return   "min " + to_string(v.front())
+              + ", median " + to_string(v[v.size() / 2])
+              + ", max " + to_string(v.back());
+    };
+
+    cerr << "\n==========================="
+         << "\nThreads               : " << Threads.size()
+         << "\nIdle spin (us)        : " << Threads.idleSpin
+         << "\nGo to all searching   : " << summary(wake) << " us"
+         << "\nGo depth 1 to bestmove: " << summary(firstInfo) << " us"
+         << "\nStop to bestmove      : " << summary(stop) << " us" << endl;
+  }
+
+
+  // bench() is called when engine receives the "bench" command. Firstly
+  // a list of UCI commands is setup according to bench parameters, then
+  // it is run one by one printing a summary at the end. "bench latency"
+  // runs bench_latency() instead.
+
+  void bench(Position& pos, istream& args, StateListPtr& states) {
+
+    string token;
+    std::streampos start = args.tellg();
+
+    if (args >> token && token == "latency")
+    {
+        bench_latency(pos, args, states);
+        return;
+    }
+
+    args.clear();
+    args.seekg(start);
+
+    TimePoint elapsed;
+    uint64_t nodes = run_bench(pos, setup_bench(pos, args), states, elapsed);
+
     dbg_print(); // Just before exiting
 
     cerr << "\n==========================="
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+
+#if defined(USE_TT_XOR)
+    cerr << "TT rejections   : " << TT.rejected() << endl;
+#endif
+  }
+
+
+  // scaling() is called when engine receives the "scaling" command. The format
+  // is "scaling [threads] [depth] [hash] [fenFile]": the bench positions are
+  // searched to a fixed depth with 1, 2, 4... up to the given number of threads
+  // and the time to depth of each run is reported, with the current search
+  // options (e.g. "Deferred Move Search").
+
+  void scaling(Position& pos, istringstream& is, StateListPtr& states) {
+
+    string token;
+    size_t maxThreads = is >> token ? size_t(std::max(std::atoi(token.c_str()), 1))
+                                    : size_t(Options["Threads"]);
+    string depth   = (is >> token) ? token : "13";
+    string ttSize  = (is >> token) ? token : "64";
+    string fenFile = (is >> token) ? token : "default";
+
+    vector<size_t> threadCounts;
+    for (size_t n = 1; n < maxThreads; n *= 2)
+        threadCounts.push_back(n);
+    threadCounts.push_back(maxThreads);
+
+    std::ostringstream report;
+    TimePoint baseTime = 0;
+
+    report << "\nThreads  Time (ms)       Nodes  Nodes/second  Speedup";
+
+    for (size_t n : threadCounts)
+    {
+        istringstream args(ttSize + " " + std::to_string(n) + " " + depth + " " + fenFile + " depth");
+        TimePoint elapsed;
+        uint64_t nodes = run_bench(pos, setup_bench(pos, args), states, elapsed);
+
+        if (!baseTime)
+            baseTime = elapsed;
+
+        report << "\n" << std::setw(7)  << n
+               << "  "  << std::setw(9)  << elapsed
+               << "  "  << std::setw(10) << nodes
+               << "  "  << std::setw(12) << 1000 * nodes / elapsed
+               << "  "  << std::setw(7)  << std::fixed << std::setprecision(2)
+                        << double(baseTime) / elapsed;
+    }
+
+    cerr << "\n==========================="
+         << "\nDeferred Move Search: " << (Options["Deferred Move Search"] ? "on" : "off")
+         << report.str() << endl;
+  }
+
+  // save_hash() is called when engine receives the "savehash" command.
+  // The format is "savehash <file> [sparse]".
+
+  void save_hash(istringstream& is) {
+
+    string fileName, token;
+    is >> fileName >> token;
+
+    TimePoint elapsed = now();
+    if (TT.save(fileName, token == "sparse"))
+        sync_cout << "info string Hash saved to " << fileName << " in "
+                  << now() - elapsed << " ms" << sync_endl;
+    else
+        sync_cout << "info string Hash could not be saved to " << fileName << sync_endl;
+  }
+
+
+  // load_hash() is called when engine receives the "loadhash" command.
+  // The format is "loadhash <file> [mmap]". The current Hash size must match.
+
+  void load_hash(istringstream& is) {
+
+    string fileName, token;
+    is >> fileName >> token;
+
+    TimePoint elapsed = now();
+    if (TT.load(fileName, token == "mmap"))
+        sync_cout << "info string Hash loaded from " << fileName << " in "
+                  << now() - elapsed << " ms, hashfull " << TT.hashfull() << sync_endl;
+  }
+
+  // hash_stats() is called when engine receives the "hashstats" command. The
+  // format is "hashstats [threads]", by default as many threads as for search.
+  // Unlike the other custom commands, it can be used during a search.
+
+  void hash_stats(istringstream& is) {
+
+    string token;
+    size_t threads = is >> token ? size_t(std::max(std::atoi(token.c_str()), 1))
+                                 : size_t(Options["Threads"]);
+
+    sync_cout << TT.stats(threads) << sync_endl;
+  }
+
+  // tb_warmup() is called when engine receives the "tbwarmup" command. The
+  // format is "tbwarmup [MB]": it maps all the tablebase files and reads in up
+  // to the given size of their data, by default the "SyzygyPreload" option.
+
+  void tb_warmup(istringstream& is) {
+
+    size_t preloadMB = size_t(int(Options["SyzygyPreload"]));
+    is >> preloadMB;
+
+    Tablebases::warmup(preloadMB);
   }
 
   // The win rate model returns the probability (per mille) of winning given an eval
@@ -331,13 +543,21 @@ void UCI::loop(int argc, char* argv[]) {
       // Do not use these commands during a search!
       else if (token == "flip")     pos.flip();
       else if (token == "bench")    bench(pos, is, states);
+      else if (token == "scaling")  scaling(pos, is, states);
+      else if (token == "perft")    run_perft(pos, is);
       else if (token == "d")        sync_cout << pos << sync_endl;
       else if (token == "eval")     trace_eval(pos);
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
+      else if (token == "savehash") save_hash(is);
+      else if (token == "loadhash") load_hash(is);
+      else if (token == "hashstats") hash_stats(is);
+      else if (token == "tbwarmup") tb_warmup(is);
+      else if (token == "stats")    sync_cout << Threads.stats() << sync_endl;
 #if defined (EVAL_LEARN)
       else if (token == "gensfen") Learner::gen_sfen(pos, is);
       else if (token == "learn") Learner::learn(pos, is);
       else if (token == "convert") Learner::convert(is);
+      else if (token == "evalbatch") Learner::eval_batch(is);
 
       // Command to call qsearch(),search() directly for testing
       else if (token == "qsearch") qsearch_cmd(pos);
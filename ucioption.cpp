@@ -37,11 +37,15 @@ namespace UCI {
 /// 'On change' actions, triggered by an option's value change
 void on_clear_hash(const Option&) { Search::clear(); }
 void on_hash_size(const Option& o) { TT.resize(size_t(o)); }
+void on_large_pages(const Option& ) { TT.resize(size_t(Options["Hash"])); }
 void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option& o) { Threads.set(size_t(o)); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
 void on_use_NNUE(const Option& ) { Eval::init_NNUE(); }
 void on_eval_file(const Option& ) { Eval::init_NNUE(); }
+void on_numa_policy(const Option& ) { Threads.set(size_t(Options["Threads"])); }
+void on_numa_replicate(const Option& o) { Eval::NNUE::replicate_eval(o); }
+void on_idle_spin(const Option& o) { Threads.idleSpin = int(o); }
 #ifdef EVAL_LEARN
 void on_prune_at_shallow_depth_on_pv_node(const Option& o) {
     Search::prune_at_shallow_depth_on_pv_node = o;
@@ -69,7 +73,12 @@ void init(OptionsMap& o) {
   o["Contempt"]              << Option(24, -100, 100);
   o["Analysis Contempt"]     << Option("Both var Off var White var Black var Both", "Both");
   o["Threads"]               << Option(1, 1, 512, on_threads);
+  o["NUMA Policy"]           << Option("auto var auto var bind var none", "auto", on_numa_policy);
+  o["NUMA Replicate NNUE"]   << Option(false, on_numa_replicate);
+  o["Deferred Move Search"]  << Option(false);
+  o["Idle Spin"]             << Option(0, 0, 1000000, on_idle_spin);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
+  o["Large Pages"]           << Option(true, on_large_pages);
   o["Clear Hash"]            << Option(on_clear_hash);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
@@ -86,6 +95,8 @@ void init(OptionsMap& o) {
   o["SyzygyProbeDepth"]      << Option(1, 1, 100);
   o["Syzygy50MoveRule"]      << Option(true);
   o["SyzygyProbeLimit"]      << Option(7, 0, 7);
+  o["SyzygyWarmup"]          << Option(false);
+  o["SyzygyPreload"]         << Option(0, 0, 1024 * 1024);
 #if defined(EVAL_LEARN)
   o["Use NNUE"]              << Option("true var true var false var pure", "true", on_use_NNUE);
 #else